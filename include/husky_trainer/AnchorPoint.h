@@ -23,6 +23,7 @@ private:
     std::string mAnchorPointName;
     sensor_msgs::PointCloud2 mPointCloud;
     geometry_msgs::Pose mPosition;
+    bool mPrepared;
 
 public:
     AnchorPoint(std::string& anchorPointName, geometry_msgs::Pose position);
@@ -32,7 +33,9 @@ public:
     ~AnchorPoint();
 
     sensor_msgs::PointCloud2 getCloud() const;
+    bool isPrepared() const;
     void loadFromDisk();
+    void loadFromDisk(const std::string& directory);
     void saveToDisk();
 
 
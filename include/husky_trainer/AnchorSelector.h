@@ -0,0 +1,27 @@
+#ifndef ANCHOR_SELECTOR_H
+#define ANCHOR_SELECTOR_H
+
+#include <geometry_msgs/Pose.h>
+
+// Decides when a new anchor point should be recorded, from the distance and
+// the angle travelled since the last one.
+class AnchorSelector {
+public:
+    AnchorSelector(double distance, double angle);
+
+    bool isNewAnchor(const geometry_msgs::Pose& pose) const;
+    void setLastAnchor(const geometry_msgs::Pose& pose);
+    void setSpacing(double distance, double angle);
+
+    double distanceSinceAnchor(const geometry_msgs::Pose& pose) const;
+    double angleSinceAnchor(const geometry_msgs::Pose& pose) const;
+    double distance() const;
+    double angle() const;
+
+private:
+    double mDistance;
+    double mAngle;
+    geometry_msgs::Pose mLastAnchor;
+};
+
+#endif
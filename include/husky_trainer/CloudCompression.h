@@ -0,0 +1,29 @@
+#ifndef CLOUD_COMPRESSION_H
+#define CLOUD_COMPRESSION_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include "husky_trainer/CompressedNamedPointCloud.h"
+
+#define DEFAULT_COMPRESSION_RESOLUTION 0.001
+
+// Lossy compression of the xyz part of a point cloud. The coordinates are
+// quantized to a fixed resolution, delta coded from point to point and
+// written as zigzag varints, which are then deflated.
+namespace cloud_compression
+{
+bool encodePoints(const std::vector<float>& xyz, float resolution, std::vector<uint8_t>& out);
+bool decodePoints(const std::vector<uint8_t>& data, float resolution,
+                  uint32_t pointCount, std::vector<float>& xyz);
+bool extractPoints(const sensor_msgs::PointCloud2& cloud, std::vector<float>& xyz);
+sensor_msgs::PointCloud2 cloudOfPoints(const std::vector<float>& xyz, const std_msgs::Header& header);
+bool compress(const std::string& name, const sensor_msgs::PointCloud2& cloud, float resolution,
+              husky_trainer::CompressedNamedPointCloud& out);
+bool decompress(const husky_trainer::CompressedNamedPointCloud& msg, sensor_msgs::PointCloud2& out);
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef CLOUD_IO_H
+#define CLOUD_IO_H
+
+#include <string>
+
+#include <sensor_msgs/PointCloud2.h>
+
+// Binary PCD files written straight from the buffer of a PointCloud2. The
+// fields are described with their offsets, padding included, so the points
+// are written as they are in memory with a single writev, and read back the
+// same way.
+namespace cloud_io
+{
+bool writePcd(const std::string& filename, const sensor_msgs::PointCloud2& cloud, bool directIo);
+bool isPcd(const std::string& filename);
+bool readPcd(const std::string& filename, sensor_msgs::PointCloud2& cloud);
+std::string pcdHeader(const sensor_msgs::PointCloud2& cloud);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CLOUD_PREPARATION_H
+#define CLOUD_PREPARATION_H
+
+#include <string>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include "pointmatcher/PointMatcher.h"
+
+// Prepares the anchor point clouds for the repeat while teaching. The cloud
+// goes through a libpointmatcher filter chain (typically the reference
+// filters of the ICP config, for instance sampling and normals) and is saved
+// next to the anchor point as a serialized PointCloud2, which the repeat
+// loads without parsing or converting anything. A prepared cloud older than
+// its cloud is from an earlier teach and is not used.
+class CloudPreparation {
+public:
+    static const std::string PREPARED_SUFFIX;
+
+    CloudPreparation();
+    bool loadFilters(const std::string& filename);
+    void prepare(PointMatcher<float>::DataPoints& cloud) const;
+
+    static std::string preparedFileOf(const std::string& cloudFile);
+    static bool isCurrent(const std::string& cloudFile);
+    static bool save(const std::string& filename, const sensor_msgs::PointCloud2& cloud);
+    static bool load(const std::string& filename, sensor_msgs::PointCloud2& cloud);
+
+private:
+    // The filters are built again for every cloud, so that concurrent
+    // preparations share nothing.
+    std::string mFilterConfig;
+};
+
+#endif
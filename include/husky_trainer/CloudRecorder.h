@@ -2,9 +2,17 @@
 #ifndef CLOUD_RECORDER_H
 #define CLOUD_RECORDER_H
 
+#include <deque>
 #include <exception>
+#include <map>
+#include <set>
 #include <string>
 #include <iostream>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <pcl/io/vtk_io.h>
 #include <pcl/io/pcd_io.h>
@@ -17,32 +25,130 @@
 #include <sensor_msgs/PointCloud2.h>
 
 #include "husky_trainer/NamedPointCloud.h"
+#include "husky_trainer/CompressedNamedPointCloud.h"
+#include "husky_trainer/CloudCompression.h"
+#include "husky_trainer/CloudIO.h"
+#include "husky_trainer/CloudPreparation.h"
+#include "husky_trainer/LatencyHistogram.h"
+#include "husky_trainer/RecorderStatus.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/WorkerPool.h"
 
 #define FILE_FORMAT_PARAM "format"
 #define DEST_TOPIC_PARAM "republish"
 #define SOURCE_TOPIC_PARAM "source"
+#define COMPRESSED_SOURCE_TOPIC_PARAM "compressed_source"
 #define TARGET_FRAME_PARAM "target_frame"
 #define WORKING_DIRECTORY_PARAM "working_directory"
+#define ROUTE_LIBRARY_PARAM "route_library"
+#define ROUTE_NAME_PARAM "route_name"
+#define WRITER_THREADS_PARAM "writer_threads"
+#define WRITE_QUEUE_PARAM "write_queue"
+#define SYNC_BATCH_PARAM "sync_batch"
+#define STATIC_TRANSFORM_PARAM "static_transform"
+#define TRANSFORM_TIMEOUT_PARAM "transform_timeout"
+#define DIRECT_IO_PARAM "direct_io"
+#define PREPARE_ANCHOR_POINTS_PARAM "prepare_anchor_points"
+#define PREP_FILTERS_PARAM "prep_filters"
+#define STATUS_TOPIC "/teach_repeat/recorder_status"
 #define DEFAULT_FORMAT "vtk"
+#define DEFAULT_WRITER_THREADS 2
+#define DEFAULT_WRITE_QUEUE 16
+#define DEFAULT_SYNC_BATCH 8
+#define DEFAULT_TRANSFORM_TIMEOUT 5.0
+#define STATUS_PERIOD 1.0
+#define RELEASE_PERIOD 0.05
+#define RECORDER_TRACE_FILE "recorder_trace.json"
 
 
+// Saves the anchor point clouds received from the teach. The callbacks only
+// park the clouds; a timer hands them to a pool of writer threads once their
+// transform to the target frame is known and the write queue has room, so
+// neither the callbacks nor the writers ever wait on tf. A cloud is only
+// given up on, and counted as failed, when its transform does not show up
+// within the timeout. Anchor points that never reached the recorder are
+// detected from the gaps in their numbering. The files are synced to disk in
+// batches. The status tells the teach to slow down when the clouds pile up
+// in the recorder, and again when they are back under half the write queue.
+// The writers also prepare the anchor points for the repeat, from the clouds
+// as they were saved.
 class CloudRecorder {
 public:
     CloudRecorder(ros::NodeHandle n);
+    ~CloudRecorder();
     void record(const husky_trainer::NamedPointCloudConstPtr& msg);
+    void recordCompressed(const husky_trainer::CompressedNamedPointCloudConstPtr& msg);
     void spin();
-    static void saveAsVTK(std::string name, const sensor_msgs::PointCloud2& cloud);
-    static void saveAsPCD(std::string name, const sensor_msgs::PointCloud2& cloud);
+    static bool saveAsVTK(std::string name, const sensor_msgs::PointCloud2& cloud);
+    static bool saveAsPCD(std::string name, const sensor_msgs::PointCloud2& cloud);
     sensor_msgs::PointCloud2 transformToFrame(const sensor_msgs::PointCloud2& cloud,
-                                              std::string targetFrame, tf::TransformListener& tf);
+                                              const tf::StampedTransform& transform) const;
 
 private:
+    // One of the two clouds is set.
+    struct PendingCloud {
+        std::string name;
+        std_msgs::Header header;
+        husky_trainer::NamedPointCloudConstPtr cloud;
+        husky_trainer::CompressedNamedPointCloudConstPtr compressedCloud;
+        ros::Time received;
+    };
+
     tf::TransformListener tfListener;
     ros::Publisher publisherTopic;
+    ros::Publisher statusTopic;
     ros::Subscriber sourceTopic;
+    ros::Subscriber compressedSourceTopic;
+    ros::Timer statusTimer;
+    ros::Timer releaseTimer;
+    std::string workingDirectory;
     std::string fileFormat;
     std::string targetFrame;
     bool republish;
+    bool directIo;
+    bool prepareClouds;
+    CloudPreparation preparation;
+
+    boost::scoped_ptr<WorkerPool> writers;
+    size_t syncBatch;
+    bool staticTransform;
+    ros::Duration transformTimeout;
+    bool backpressure;
+
+    // Touched by the callbacks only.
+    unsigned int receivedClouds;
+    std::set<long> receivedIndices;
+    std::deque<PendingCloud> pendingClouds;
+    std::map<std::string, tf::StampedTransform> staticTransforms;  // By source frame.
+    ros::WallTime lastStatusTime;
+    unsigned int lastWrittenClouds;
+    uint64_t lastWrittenBytes;
+
+    // Shared with the writer threads.
+    boost::mutex statsMutex;
+    unsigned int writtenClouds;
+    unsigned int failedClouds;
+    uint64_t writtenBytes;
+    std::vector<std::string> unsyncedFiles;
+    LatencyHistogram queueLatency;
+    LatencyHistogram writeLatency;
+
+    void enqueue(const PendingCloud& pending);
+    bool needsTransform(const std_msgs::Header& header) const;
+    bool findTransform(const std_msgs::Header& header, tf::StampedTransform& out);
+    void releasePending(bool wait);
+    void releaseCallback(const ros::TimerEvent& event);
+    void writeCloud(const PendingCloud& pending, const tf::StampedTransform& transform);
+    void saveCloud(const std::string& name, const sensor_msgs::PointCloud2& cloud,
+                   const tf::StampedTransform& transform);
+    void prepareCloud(const std::string& filename, const sensor_msgs::PointCloud2& cloud);
+    void countFailure();
+    void syncFiles(const std::vector<std::string>& files) const;
+    unsigned int missingClouds() const;
+    husky_trainer::RecorderStatus status();
+    void startStatusWindow();
+    void updateBackpressure();
+    void statusCallback(const ros::TimerEvent& event);
 };
 
 #endif
@@ -2,17 +2,45 @@
 #ifndef COMMAND_REPEATER_H
 #define COMMAND_REPEATER_H
 
+#include <deque>
+
 #include <ros/ros.h>
 #include <geometry_msgs/Twist.h>
 
+#include "husky_trainer/CommandRepeaterStats.h"
+#include "husky_trainer/LatencyHistogram.h"
+#include "husky_trainer/LatencyProbe.h"
+#include "husky_trainer/LatencyProbeEcho.h"
+
 #define COMMAND_RATE 50
 #define INPUT_TOPIC_PARAM "input"
 #define OUTPUT_TOPIC_PARAM "output"
 #define TIMEOUT_PARAM "timeout"
+#define FORWARD_IMMEDIATELY_PARAM "forward_immediately"
+#define LATENCY_PROBES_PARAM "latency_probes"
 #define DEFAULT_TIMEOUT 1.0
 #define DEFAULT_INPUT_TOPIC "/desired_command"
 #define DEFAULT_OUTPUT_TOPIC "/husky/cmd_vel"
+#define STATS_TOPIC "/teach_repeat/command_repeater_stats"
+#define STATS_PERIOD 1.0
+#define PROBE_TOPIC "/teach_repeat/latency_probe"
+#define PROBE_ECHO_TOPIC "/teach_repeat/latency_probe_echo"
+#define PROBE_WINDOW 1.0  // Seconds a probe waits for its command.
+#define RECEIVED_HISTORY 256
 
+// Repeats the desired command at COMMAND_RATE until it times out. With
+// forward_immediately, a new command is also published as soon as it comes
+// in, and the periodic repeat only keeps the robot fed between commands. The
+// timeout is a one shot timer restarted by every command. The age of the
+// published commands and the jitter of the repeat are published every
+// STATS_PERIOD, over the STATS_PERIOD since the last message: the counts and
+// histograms start over with each message.
+//
+// With latency_probes, the probes of the repeat are matched with the first
+// command received after the probe's command_published. When that command
+// is forwarded, a LatencyProbeEcho is sent. The commands themselves are left
+// untouched. Probes whose command is never forwarded (an idle command, for
+// instance) get no echo.
 class CommandRepeater {
 public:
     CommandRepeater(ros::NodeHandle n);
@@ -22,16 +50,44 @@ public:
     inline static bool isNullVector(geometry_msgs::Vector3 vector);
 
 private:
+    // A received command, and when it first went out if it did.
+    struct ReceivedCommand {
+        ros::Time received;
+        ros::Time forwarded;
+    };
+
     geometry_msgs::Twist desiredCommand;
     ros::Subscriber desiredCommandTopic;
     ros::Publisher outputCommandTopic;
+    ros::Publisher statsTopic;
     ros::Timer publishTimer;
+    ros::Timer timeoutTimer;
+    ros::Timer statsTimer;
     ros::Time lastCommandReceiveTime;
+    ros::Time lastPublishTime;
     ros::Duration timeout;
+    bool forwardImmediately;
+    bool commandExpired;
+
+    LatencyHistogram commandAge;
+    LatencyHistogram timerJitter;
+    unsigned int forwardedCommands;
+    unsigned int timeouts;
+
+    bool latencyProbes;
+    ros::Subscriber probeTopic;
+    ros::Publisher probeEchoTopic;
+    uint32_t lastProbeSeq;
+    std::deque<husky_trainer::LatencyProbe> pendingProbes;
+    std::deque<ReceivedCommand> receivedCommands;
 
     void publishTimerCallback(const ros::TimerEvent&);
+    void timeoutCallback(const ros::TimerEvent&);
+    void statsCallback(const ros::TimerEvent& event);
     void updateDesiredCommand(const geometry_msgs::Twist::ConstPtr& msg);
     void publishCommand(const geometry_msgs::Twist msg);
+    void probeCallback(const husky_trainer::LatencyProbe::ConstPtr& msg);
+    void echoProbes();
 };
 
 #endif
@@ -4,7 +4,6 @@
 
 #include <boost/tuple/tuple.hpp>
 #include <geometry_msgs/Twist.h>
-#include <dynamic_reconfigure/server.h>
 
 #include "husky_trainer/RepeatConfig.h"
 #include "husky_trainer/TrajectoryError.h"
@@ -12,22 +11,19 @@
 
 class Controller {
     public:
-        Controller(ros::NodeHandle n);
+        Controller();
         geometry_msgs::Twist correctCommand(geometry_msgs::Twist command);
-        void updateError(husky_trainer::TrajectoryError newError);
+        husky_trainer::TrajectoryError updateError(husky_trainer::TrajectoryError newError);
         void updateParams(husky_trainer::RepeatConfig& params);
 
     private:
         static const double SAMPLING_PERIOD;
-        static const std::string CORRECTED_ERROR_TOPIC;
 
         husky_trainer::TrajectoryError currentError;
         double lambdaX, lambdaY, lambdaTheta;
         double lpFilterTimeConstant;
         double minLinearSpeed, maxLinearSpeed, minAngularSpeed, maxAngularSpeed;
 
-        ros::Publisher correctedErrorTopic;
-
         geometry_msgs::Twist cutoff(geometry_msgs::Twist command);
         double iir(double old, double input);
         geometry_msgs::Twist proportionalGain(geometry_msgs::Twist input);
@@ -26,6 +26,7 @@ double quatTo2dYaw(const geometry_msgs::Quaternion quat);
 double quatTo2dYaw(const Eigen::Quaternionf quat);
 Eigen::Transform<double,3,Eigen::Affine> eigenTransformOfPoses(geometry_msgs::Pose from, geometry_msgs::Pose to);
 PM::TransformationParameters pmTransFromPoseToPose(geometry_msgs::Pose from, geometry_msgs::Pose to);
+PM::TransformationParameters pmTransOfPose(const geometry_msgs::Pose& pose);
 tf::Transform transFromPoseToPose(geometry_msgs::Pose from, geometry_msgs::Pose to);
 double customDistance(const geometry_msgs::Pose& lhs, const geometry_msgs::Pose& rhs);
 std::string poseToString(geometry_msgs::Pose pose);
@@ -0,0 +1,39 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+
+#include "husky_trainer/LatencySummary.h"
+
+// Histogram of latencies in microseconds, with buckets of about 6% of their
+// value: 32 exact buckets, then 16 buckets per power of two. Any thread may
+// record while another one reads the percentiles, the counts are atomic.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t microseconds);
+    void reset();
+
+    uint64_t count() const;
+    uint64_t max() const;
+    double mean() const;
+    uint64_t percentile(double percent) const;
+    husky_trainer::LatencySummary summary() const;
+
+    static uint64_t monotonicMicroseconds();
+    static size_t bucketOf(uint64_t microseconds);
+    static uint64_t highestValueOf(size_t bucket);
+
+private:
+    static const size_t BUCKET_COUNT = 592;
+
+    boost::atomic<uint64_t> mCounts[BUCKET_COUNT];
+    boost::atomic<uint64_t> mCount;
+    boost::atomic<uint64_t> mSum;
+    boost::atomic<uint64_t> mMax;
+};
+
+#endif
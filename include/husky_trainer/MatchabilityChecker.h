@@ -0,0 +1,78 @@
+#ifndef MATCHABILITY_CHECKER_H
+#define MATCHABILITY_CHECKER_H
+
+#include <deque>
+#include <string>
+
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <geometry_msgs/Pose.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "pointmatcher/PointMatcher.h"
+
+#define DEFAULT_MATCHABILITY_INLIER_DISTANCE 0.3
+
+// Checks that consecutive anchor points can be matched against each other,
+// on a single low priority thread so that it only uses the idle time of the
+// teach. Each check aligns the two scans with ICP, starting from the
+// odometry, then measures the fraction of the points of the reading that
+// have a neighbour in the reference (the overlap) and the RMS distance to
+// those neighbours (the residual). Checks that come in while the queue is
+// full are dropped. The checks still queued when the checker is destroyed
+// are dropped as well, waitUntilIdle lets them finish first.
+class MatchabilityChecker {
+public:
+    typedef PointMatcher<float> PM;
+
+    struct Scan {
+        std::string name;
+        sensor_msgs::PointCloud2ConstPtr cloud;
+        geometry_msgs::Pose pose;
+    };
+
+    struct Result {
+        Scan reference;
+        Scan reading;
+        double overlap;
+        double residual;
+    };
+
+    MatchabilityChecker(const PM::TransformationParameters& lidarToRobot, const std::string& icpConfig,
+                        double inlierDistance, size_t capacity);
+    ~MatchabilityChecker();
+
+    bool submit(const Scan& reference, const Scan& reading);
+    bool takeResult(Result& out);
+    void waitUntilIdle();
+    unsigned int droppedCount() const;
+
+private:
+    struct Check {
+        Scan reference;
+        Scan reading;
+    };
+
+    PM::TransformationParameters mLidarToRobot;
+    double mInlierDistance;
+    size_t mCapacity;
+    std::string mIcpConfig;
+    bool mStopping;
+    bool mChecking;
+    unsigned int mDropped;
+
+    std::deque<Check> mChecks;
+    std::deque<Result> mResults;
+    mutable boost::mutex mMutex;
+    boost::condition_variable mCheckAvailable;
+    boost::condition_variable mIdle;
+    boost::thread mThread;
+
+    void work();
+    void lowerPriority() const;
+    Result check(const Check& check, PM::ICP& icp) const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef OVERLAP_ESTIMATOR_H
+#define OVERLAP_ESTIMATOR_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/unordered_set.hpp>
+#include <Eigen/Geometry>
+
+#include <geometry_msgs/Pose.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#define DEFAULT_OVERLAP_VOXEL_SIZE 0.5
+#define DEFAULT_OVERLAP_MAX_RANGE 30.0
+
+// Estimates how much of a scan was already seen by a reference scan. Both
+// scans are placed in the odometry frame and cut in voxels, the overlap is
+// the fraction of the voxels of the scan that are also voxels of the
+// reference. The work is done on a background thread: submitting a scan
+// replaces the one waiting to be evaluated, so the estimator never falls
+// behind, it only skips scans.
+class OverlapEstimator {
+public:
+    struct Result {
+        sensor_msgs::PointCloud2ConstPtr scan;
+        geometry_msgs::Pose pose;
+        double overlap;
+    };
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    OverlapEstimator(const Eigen::Matrix4f& lidarToRobot, double voxelSize, double maxRange);
+    ~OverlapEstimator();
+
+    void submit(const sensor_msgs::PointCloud2ConstPtr& scan, const geometry_msgs::Pose& pose);
+    bool takeResult(Result& out);
+    void setReference(const sensor_msgs::PointCloud2ConstPtr& scan, const geometry_msgs::Pose& pose);
+    bool hasReference() const;
+
+private:
+    typedef boost::unordered_set<uint64_t> VoxelSet;
+
+    Eigen::Affine3f mLidarToRobot;
+    double mVoxelSize;
+    double mMaxRange;
+
+    Result mPending;
+    bool mHasPending;
+    Result mResult;
+    bool mHasResult;
+    Result mNewReference;
+    bool mHasNewReference;
+    bool mHasReference;
+    bool mStopping;
+
+    // Only touched by the worker thread.
+    VoxelSet mReferenceVoxels;
+
+    mutable boost::mutex mMutex;
+    boost::condition_variable mWorkAvailable;
+    boost::thread mThread;
+
+    void work();
+    void voxelize(const sensor_msgs::PointCloud2& scan, const geometry_msgs::Pose& pose,
+                  VoxelSet& out) const;
+    double overlapWithReference(const VoxelSet& voxels) const;
+};
+
+#endif
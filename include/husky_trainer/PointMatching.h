@@ -24,5 +24,8 @@ bool validateTransformation(PointMatcher<float>::TransformationParameters t);
 husky_trainer::TrajectoryError controlErrorOfTransformation(geometry_msgs::Transform transformation);
 sensor_msgs::PointCloud2 applyTransform(const sensor_msgs::PointCloud2 &cloud,
                                         PointMatcher<float>::TransformationParameters transform);
+void saveTransformedCloud(const sensor_msgs::PointCloud2ConstPtr& cloud,
+                          PointMatcher<float>::TransformationParameters transform,
+                          const std::string& filename);
 }
 #endif
@@ -4,6 +4,8 @@
 
 #include <string>
 #include <vector>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
@@ -27,14 +29,34 @@
 #include "husky_trainer/PointMatching.h"
 #include "husky_trainer/AnchorPointSwitch.h"
 #include "husky_trainer/Controller.h"
+#include "husky_trainer/LatencyHistogram.h"
+#include "husky_trainer/RepeatStats.h"
 #include "husky_trainer/TrajectoryError.h"
 #include "husky_trainer/RepeatConfig.h"
+#include "husky_trainer/RepeatClock.h"
+#include "husky_trainer/RepeatIO.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/RouteGraph.h"
+#include "husky_trainer/WorkerPool.h"
 
 class Repeat {
 public:
+    static const double LOOP_RATE;
+
+    // Only reads the parameters, load() reads the teach and starts listening.
     Repeat(ros::NodeHandle n);
+    // Without ROS, for a replay. The matching is done in the calling thread,
+    // so the outputs only depend on the order of the calls and the clock.
+    Repeat(const std::string& routeDirectory, const tf::Transform& lidarToRobot,
+           husky_trainer::RepeatConfig config, RepeatClock& clock, RepeatIO& io);
     ~Repeat();
+    bool load(ros::NodeHandle n);
     void spin();
+    void startPlaybackTimer(ros::NodeHandle n);
+
+    void tick();
+    void cloudCallback(const sensor_msgs::PointCloud2ConstPtr msg);
+    void joystickCallback(sensor_msgs::Joy::ConstPtr msg);
 
 private:
     enum Status { FORWARD = 0, REWIND, PAUSE, ERROR };
@@ -45,23 +67,30 @@ private:
     static const std::string SOURCE_TOPIC_PARAM;
     static const std::string COMMAND_OUTPUT_PARAM;
     static const std::string WORKING_DIRECTORY_PARAM;
+    static const std::string ROUTE_LIBRARY_PARAM;
+    static const std::string ROUTE_PARAM;
+    static const std::string START_ANCHOR_PARAM;
+    static const std::string GOAL_ROUTE_PARAM;
+    static const std::string GOAL_ANCHOR_PARAM;
+    static const std::string LATENCY_PROBES_PARAM;
 
     // Default values.
     static const std::string DEFAULT_SOURCE_TOPIC;
-    static const std::string DEFAULT_COMMAND_OUTPUT_TOPIC;
 
     // Other constants.
-    static const double LOOP_RATE;
     static const std::string JOY_TOPIC;
-    static const std::string REFERENCE_POSE_TOPIC;
-    static const std::string ERROR_REPORTING_TOPIC;
-    static const std::string AP_SWITCH_TOPIC;
-    static const std::string CLOUD_MATCHING_SERVICE;
+    static const double STATS_PERIOD;
+    static const std::string TRACE_FILE;
     static const std::string LIDAR_FRAME;
     static const std::string ROBOT_FRAME;
     static const std::string WORLD_FRAME;
 
     // Variables.
+    boost::scoped_ptr<RepeatClock> rosClock;
+    boost::scoped_ptr<RepeatIO> rosIO;
+    RepeatClock* clock;
+    RepeatIO* io;
+    bool synchronousMatching;
     Status currentStatus;
     Controller controller;
     ros::Duration lookahead;
@@ -70,8 +99,9 @@ private:
     ros::Time baseSimTime;
     ros::Time timePlaybackStarted;
     ros::Rate loopRate;
-    dynamic_reconfigure::Server<husky_trainer::RepeatConfig> drServer;
+    boost::scoped_ptr<dynamic_reconfigure::Server<husky_trainer::RepeatConfig> > drServer;
 
+    std::string routeDirectory;  // Of the first route of a planned path.
     std::vector<AnchorPoint> anchorPoints;
     std::vector<geometry_msgs::PoseStamped> positions;
     std::vector<geometry_msgs::TwistStamped> commands;
@@ -81,19 +111,42 @@ private:
 
     ros::Subscriber readingTopic;
     ros::Subscriber joystickTopic;
-    ros::Publisher commandRepeaterTopic;
-    ros::Publisher errorReportingTopic;
-    ros::Publisher referencePoseTopic;
-    ros::Publisher anchorPointSwitchTopic;
-    ros::ServiceClient icpService;
-    boost::mutex serviceCallLock;
+    ros::Timer playbackTimer;
+    ros::Timer statsTimer;
+
+    // Matches the clouds one at a time, the clouds that come in while it is
+    // busy are dropped.
+    boost::scoped_ptr<WorkerPool> matchingPool;
+
+    // The last correction, until it goes out in a command.
+    bool latencyProbes;
+    boost::mutex probeMutex;
+    husky_trainer::LatencyProbe pendingProbe;
+    bool probePending;
+    uint32_t probeSeq;  // Touched by the playback only.
+
+    // Timing of the corrections, over a window of STATS_PERIOD.
+    LatencyHistogram receiveLatency;
+    LatencyHistogram copyLatency;
+    LatencyHistogram transformLatency;
+    LatencyHistogram matchingLatency;
+    LatencyHistogram controllerLatency;
+    LatencyHistogram totalLatency;
+    boost::atomic<unsigned int> receivedClouds;
+    boost::atomic<unsigned int> droppedClouds;
+    boost::atomic<unsigned int> failedMatches;
 
     // Functions.
+    static std::string routeDirectoryOfParams(ros::NodeHandle& n);
+    bool loadPlannedRoute(ros::NodeHandle& n);
+    void loadRoute(const std::string& routeDirectory);
+    void startAtBeginning();
+    bool composeLegs(const RouteLibrary& library, const std::vector<RouteLeg>& legs);
+    static size_t closestPositionIndex(const std::vector<geometry_msgs::PoseStamped>& positions,
+                                       const geometry_msgs::Pose& pose, size_t from);
     static void loadAnchorPoints(std::string filename, std::vector<AnchorPoint>& out);
     static void loadCommands(std::string filename, std::vector<geometry_msgs::TwistStamped>& out);
     static void loadPositions(std::string filename, std::vector<geometry_msgs::PoseStamped>& out);
-    void cloudCallback(const sensor_msgs::PointCloud2ConstPtr msg);
-    void joystickCallback(sensor_msgs::Joy::ConstPtr msg);
 
     // Time management.
     void switchToStatus(Status desiredStatus);
@@ -102,7 +155,10 @@ private:
     ros::Time simTime();
     ros::Time trySubtract(ros::Duration value, ros::Time from);
 
-    void updateError(const sensor_msgs::PointCloud2& msg);
+    void playbackTimerCallback(const ros::TimerEvent&);
+    void updateError(const sensor_msgs::PointCloud2ConstPtr& msg, uint64_t receivedAt, ros::Time receivedTime);
+    bool takeLatencyProbe(const geometry_msgs::Twist& command, husky_trainer::LatencyProbe& probe);
+    void statsCallback(const ros::TimerEvent& event);
     void updateAnchorPoint();
     geometry_msgs::Twist commandOfTime(ros::Time time);
     static geometry_msgs::Twist reverseCommand(geometry_msgs::Twist input);
@@ -0,0 +1,19 @@
+#ifndef REPEAT_CLOCK_H
+#define REPEAT_CLOCK_H
+
+#include <ros/time.h>
+
+// The time the playback of the repeat follows. On the robot it is the ROS
+// clock, a replay sets it from the recorded messages.
+class RepeatClock {
+public:
+    virtual ~RepeatClock() { }
+    virtual ros::Time now() const = 0;
+};
+
+class RosRepeatClock : public RepeatClock {
+public:
+    virtual ros::Time now() const { return ros::Time::now(); }
+};
+
+#endif
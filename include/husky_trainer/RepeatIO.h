@@ -0,0 +1,33 @@
+#ifndef REPEAT_IO_H
+#define REPEAT_IO_H
+
+#include <geometry_msgs/Pose.h>
+#include <geometry_msgs/Twist.h>
+
+#include "pointmatcher_ros/MatchClouds.h"
+
+#include "husky_trainer/AnchorPointSwitch.h"
+#include "husky_trainer/LatencyProbe.h"
+#include "husky_trainer/RepeatStats.h"
+#include "husky_trainer/TrajectoryError.h"
+
+// Everything the repeat sends out, and the matching of the readings on the
+// anchor points. On the robot these are topics and the match_clouds service,
+// see RosRepeatIO. matchClouds is called from the matching threads, the rest
+// from the thread driving the repeat as well. A prepared reference already
+// went through the reference filters of the ICP.
+class RepeatIO {
+public:
+    virtual ~RepeatIO() { }
+
+    virtual void publishCommand(const geometry_msgs::Twist& command) = 0;
+    virtual void publishReferencePose(const geometry_msgs::Pose& pose) = 0;
+    virtual void publishRawError(const husky_trainer::TrajectoryError& error) = 0;
+    virtual void publishCorrectedError(const husky_trainer::TrajectoryError& error) = 0;
+    virtual void publishAnchorPointSwitch(const husky_trainer::AnchorPointSwitch& msg) = 0;
+    virtual void publishStats(const husky_trainer::RepeatStats& stats) = 0;
+    virtual void publishLatencyProbe(const husky_trainer::LatencyProbe& probe) = 0;
+    virtual bool matchClouds(pointmatcher_ros::MatchClouds& match, bool preparedReference) = 0;
+};
+
+#endif
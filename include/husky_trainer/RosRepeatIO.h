@@ -0,0 +1,48 @@
+#ifndef ROS_REPEAT_IO_H
+#define ROS_REPEAT_IO_H
+
+#include <string>
+
+#include <ros/ros.h>
+
+#include "husky_trainer/RepeatIO.h"
+
+// The outputs of the repeat on the robot.
+class RosRepeatIO : public RepeatIO {
+public:
+    RosRepeatIO(ros::NodeHandle& n);
+
+    virtual void publishCommand(const geometry_msgs::Twist& command);
+    virtual void publishReferencePose(const geometry_msgs::Pose& pose);
+    virtual void publishRawError(const husky_trainer::TrajectoryError& error);
+    virtual void publishCorrectedError(const husky_trainer::TrajectoryError& error);
+    virtual void publishAnchorPointSwitch(const husky_trainer::AnchorPointSwitch& msg);
+    virtual void publishStats(const husky_trainer::RepeatStats& stats);
+    virtual void publishLatencyProbe(const husky_trainer::LatencyProbe& probe);
+    virtual bool matchClouds(pointmatcher_ros::MatchClouds& match, bool preparedReference);
+
+private:
+    static const std::string COMMAND_OUTPUT_TOPIC;
+    static const std::string REFERENCE_POSE_TOPIC;
+    static const std::string ERROR_REPORTING_TOPIC;
+    static const std::string CORRECTED_ERROR_TOPIC;
+    static const std::string AP_SWITCH_TOPIC;
+    static const std::string STATS_TOPIC;
+    static const std::string LATENCY_PROBE_TOPIC;
+    static const std::string CLOUD_MATCHING_SERVICE;
+    static const std::string PREPARED_CLOUD_MATCHING_SERVICE;
+    static const std::string PREPARED_MATCHER_PARAM;
+
+    ros::Publisher commandRepeaterTopic;
+    ros::Publisher referencePoseTopic;
+    ros::Publisher errorReportingTopic;
+    ros::Publisher correctedErrorTopic;
+    ros::Publisher anchorPointSwitchTopic;
+    ros::Publisher statsTopic;
+    ros::Publisher latencyProbeTopic;
+    ros::ServiceClient icpService;
+    ros::ServiceClient preparedIcpService;
+    bool preparedMatcher;
+};
+
+#endif
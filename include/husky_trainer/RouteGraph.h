@@ -0,0 +1,78 @@
+#ifndef ROUTE_GRAPH_H
+#define ROUTE_GRAPH_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <geometry_msgs/Pose.h>
+
+#include "husky_trainer/RouteLibrary.h"
+
+// A place where an anchor point of one route overlaps an anchor point of
+// another route. The robot can switch from one route to the other there.
+struct Junction {
+    std::string fromRoute;
+    int fromAnchor;
+    std::string toRoute;
+    int toAnchor;
+    double distance;
+};
+
+// A contiguous piece of a taught route, played forward from firstAnchor to
+// lastAnchor.
+struct RouteLeg {
+    std::string route;
+    int firstAnchor;
+    int lastAnchor;
+};
+
+// Graph whose nodes are the anchor points of all the routes of a library.
+// Consecutive anchor points of a route are linked in the teach direction,
+// and junctions link anchor points of different routes both ways.
+class RouteGraph {
+public:
+    static const std::string GRAPH_FILE;
+
+    RouteGraph();
+
+    void addRoute(const std::string& name, const std::vector<geometry_msgs::Pose>& anchorPoses);
+    bool loadRoutes(const RouteLibrary& library);
+    int detectJunctions(double radius);
+
+    bool load(const std::string& filename);
+    bool save(const std::string& filename) const;
+
+    bool plan(const std::string& fromRoute, int fromAnchor,
+              const std::string& toRoute, int toAnchor,
+              std::vector<RouteLeg>& out) const;
+
+    int anchorCount(const std::string& route) const;
+    std::vector<Junction> junctions() const;
+
+    static bool loadAnchorPoses(const std::string& filename, std::vector<geometry_msgs::Pose>& out);
+
+private:
+    // Cost added to every route switch, in meters, so that the planner does
+    // not hop between two overlapping routes for no reason.
+    static const double SWITCH_PENALTY;
+
+    struct Edge {
+        int from;
+        int to;
+        double cost;
+    };
+
+    std::vector<std::string> mRouteNames;
+    std::map<std::string, int> mRouteIndices;
+    std::vector<std::vector<geometry_msgs::Pose> > mAnchorPoses;
+    std::vector<int> mNodeOffsets;
+    std::vector<Edge> mJunctionEdges;
+
+    int nodeOf(int route, int anchor) const;
+    void routeOfNode(int node, int& route, int& anchor) const;
+    int nodeCount() const;
+    void addJunction(int fromNode, int toNode, double distance);
+};
+
+#endif
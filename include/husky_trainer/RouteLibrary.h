@@ -0,0 +1,58 @@
+#ifndef ROUTE_LIBRARY_H
+#define ROUTE_LIBRARY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <geometry_msgs/Pose.h>
+
+// Summary of a taught route, as stored in the library index.
+struct RouteEntry {
+    std::string name;
+    unsigned int anchorCount;
+    double minX, minY, maxX, maxY;
+
+    RouteEntry();
+    double distanceTo(double x, double y) const;
+};
+
+// A route library is a directory holding one subdirectory per taught route,
+// along with an index file that summarizes all of them. The index lets us
+// open a route by name, or find the routes close to a pose, without looking
+// at the route directories.
+class RouteLibrary {
+public:
+    static const std::string INDEX_FILE;
+    static const std::string POSITIONS_FILE;
+    static const std::string COMMANDS_FILE;
+    static const std::string ANCHOR_POINTS_FILE;
+    static const std::string START_TIME_FILE;
+
+    RouteLibrary(const std::string& root);
+
+    bool loadIndex();
+    bool saveIndex() const;
+
+    std::string root() const;
+    std::string routeDirectory(const std::string& name) const;
+    bool findRoute(const std::string& name, RouteEntry& out) const;
+    std::vector<RouteEntry> routes() const;
+    std::vector<RouteEntry> routesNear(const geometry_msgs::Pose& pose, double radius) const;
+
+    bool indexRoute(const std::string& name);
+    void removeRoute(const std::string& name);
+    int rebuildIndex();
+
+    static bool summarizeRoute(const std::string& name, const std::string& directory, RouteEntry& out);
+    static std::string joinPath(const std::string& directory, const std::string& filename);
+
+private:
+    std::string mRoot;
+    std::map<std::string, RouteEntry> mRoutes;
+};
+
+std::ostream& operator<<(std::ostream& out, const RouteEntry& entry);
+std::istream& operator>>(std::istream& in, RouteEntry& entry);
+
+#endif
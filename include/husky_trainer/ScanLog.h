@@ -0,0 +1,116 @@
+#ifndef SCAN_LOG_H
+#define SCAN_LOG_H
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <Eigen/Core>
+
+#include <ros/ros.h>
+#include <geometry_msgs/Pose.h>
+#include <sensor_msgs/PointCloud2.h>
+
+// A scan log holds every lidar scan of a teach, compressed with the
+// cloud_compression codec. The data file starts with a header holding the
+// lidar to robot transform, followed by one record per scan. The index file
+// holds one fixed size entry per scan, sorted by time, so the scans can be
+// looked up by time or position without reading the data file.
+namespace scan_log
+{
+extern const std::string DATA_FILE;
+extern const std::string INDEX_FILE;
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    float lidarToRobot[16];
+};
+
+struct RecordHeader {
+    double stamp;
+    double pose[7];
+    float resolution;
+    uint32_t pointCount;
+    uint32_t dataSize;
+    uint32_t reserved;
+};
+
+struct IndexEntry {
+    double stamp;
+    uint64_t offset;
+    double x;
+    double y;
+    double yaw;
+};
+}
+
+// Writes a scan log from a background thread. Logging a scan only queues a
+// pointer to it, and the scan is dropped if the queue is full, so the caller
+// never waits on the disk.
+class ScanLogWriter {
+public:
+    ScanLogWriter(const std::string& directory, const Eigen::Matrix4f& lidarToRobot,
+                  float resolution, size_t capacity);
+    ~ScanLogWriter();
+
+    bool isOpen() const;
+    bool log(const sensor_msgs::PointCloud2ConstPtr& scan, const geometry_msgs::Pose& pose);
+    void setPaused(bool paused);
+    bool isPaused() const;
+
+    uint64_t loggedCount() const;
+    uint64_t droppedCount() const;
+
+private:
+    struct PendingScan {
+        sensor_msgs::PointCloud2ConstPtr scan;
+        geometry_msgs::Pose pose;
+    };
+
+    FILE* mDataFile;
+    FILE* mIndexFile;
+    uint64_t mOffset;
+    float mResolution;
+    size_t mCapacity;
+    bool mStopping;
+    bool mPaused;
+    uint64_t mLogged;
+    uint64_t mDropped;
+    std::deque<PendingScan> mQueue;
+    mutable boost::mutex mMutex;
+    boost::condition_variable mScanAvailable;
+    boost::thread mThread;
+
+    void work();
+    bool write(const PendingScan& pending);
+};
+
+class ScanLogReader {
+public:
+    ScanLogReader();
+    ~ScanLogReader();
+
+    bool open(const std::string& directory);
+    size_t size() const;
+    const scan_log::IndexEntry& entry(size_t i) const;
+    size_t indexOfTime(ros::Time time) const;
+    bool readPose(size_t i, geometry_msgs::Pose& pose);
+    bool readScan(size_t i, sensor_msgs::PointCloud2& scan, geometry_msgs::Pose& pose);
+    Eigen::Matrix4f lidarToRobot() const;
+
+private:
+    FILE* mDataFile;
+    scan_log::FileHeader mHeader;
+    std::vector<scan_log::IndexEntry> mIndex;
+
+    bool readRecordHeader(size_t i, scan_log::RecordHeader& record);
+    static geometry_msgs::Pose poseOfRecord(const scan_log::RecordHeader& record);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SYNTHETIC_ROUTE_H
+#define SYNTHETIC_ROUTE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+
+#include <geometry_msgs/Pose.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#define DEFAULT_SYNTHETIC_AP_DISTANCE 0.5
+#define DEFAULT_SYNTHETIC_SPEED 0.5
+#define DEFAULT_SYNTHETIC_POINTS 5000
+#define DEFAULT_SYNTHETIC_RANGE 20.0
+#define DEFAULT_SYNTHETIC_TILE_LENGTH 10.0
+
+// Writes a teach of any length without driving it: positions.pl, speeds.sl,
+// anchorPoints.apd and one cloud per anchor point. The robot drives at a
+// constant speed along a path whose curvature is a sum of sinusoids. By
+// default the world is a field of pillars, one or none per cell of a grid
+// depending on a hash of the cell, and the scan of an anchor point holds the
+// pillars within range of it, so neighbouring anchor points see the same
+// pillars. With a template cloud, copies of the template are laid along the
+// path every tile length instead, and an anchor point sees the last one it
+// passed.
+// Everything depends on the seed only, the same route comes out every time.
+class SyntheticRoute {
+public:
+    SyntheticRoute(unsigned int seed, double anchorDistance, double speed);
+
+    void setPointCount(size_t pointCount);
+    void setRange(double range);
+    bool setTemplate(const sensor_msgs::PointCloud2& cloud, double tileLength);
+
+    bool write(const std::string& directory, size_t anchorCount, unsigned int threadCount) const;
+
+    static std::string anchorPointName(size_t index);
+
+private:
+    unsigned int mSeed;
+    double mAnchorDistance;
+    double mSpeed;
+    size_t mPointCount;
+    double mRange;
+    std::vector<float> mTemplate;
+    double mTileLength;
+
+    double curvature(double distance) const;
+    void writeScan(const geometry_msgs::Pose& pose, const geometry_msgs::Pose& tile, size_t index,
+                   const std::string& filename, boost::atomic<unsigned int>& failures) const;
+    void pillarPoints(const geometry_msgs::Pose& pose, size_t index, std::vector<float>& xyz) const;
+    void templatePoints(const geometry_msgs::Pose& pose, const geometry_msgs::Pose& tile,
+                        std::vector<float>& xyz) const;
+    double cellHash(int64_t i, int64_t j, uint64_t salt) const;
+};
+
+#endif
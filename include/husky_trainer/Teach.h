@@ -0,0 +1,125 @@
+#ifndef TEACH_CLASS_H
+#define TEACH_CLASS_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <ros/ros.h>
+#include <sensor_msgs/Joy.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <geometry_msgs/Pose.h>
+#include <geometry_msgs/Twist.h>
+#include <nav_msgs/Odometry.h>
+
+#include "pointmatcher/PointMatcher.h"
+
+#include "husky_trainer/AnchorPoint.h"
+#include "husky_trainer/AnchorSelector.h"
+#include "husky_trainer/LatencyHistogram.h"
+#include "husky_trainer/MatchabilityChecker.h"
+#include "husky_trainer/OverlapEstimator.h"
+#include "husky_trainer/RecorderStatus.h"
+#include "husky_trainer/ScanLog.h"
+#include "husky_trainer/TeachStats.h"
+#include "husky_trainer/TrajectoryWriter.h"
+#include "husky_trainer/WorkerPool.h"
+
+// Records a teach: the trajectory of the robot, the commands it was given and
+// the anchor point clouds. The callbacks must not run concurrently, which is
+// the case with ros::spinOnce or with the node handle of a nodelet. The teach
+// is saved when the object is destroyed.
+class Teach {
+public:
+    Teach(ros::NodeHandle n);
+    ~Teach();
+    void spin();
+
+private:
+    typedef PointMatcher<float> PM;
+
+    std::string workingDirectory;
+    std::string routeLibraryRoot;
+    std::string routeName;
+    PM::TransformationParameters tLidarToBaseLink;
+
+    bool compressClouds;
+    double compressionResolution;
+    double overlapThreshold;
+
+    AnchorSelector anchorSelector;
+    double anchorDistance;
+    double anchorAngle;
+
+    // While the cloud recorder is behind, the anchor points are spaced out
+    // and the scan log is paused. Without news from the recorder for a while,
+    // the teach goes back to normal.
+    double backpressureSpacing;
+    double spacingFactor;
+    bool recorderBehind;
+    ros::Time lastRecorderStatus;
+    boost::scoped_ptr<TrajectoryWriter> trajectoryWriter;
+    boost::scoped_ptr<ScanLogWriter> scanLog;
+    boost::scoped_ptr<OverlapEstimator> overlapEstimator;
+
+    // Matchability checks of consecutive anchor points. The recent scans are
+    // kept to insert an anchor point between two that do not match well.
+    boost::scoped_ptr<MatchabilityChecker> matchabilityChecker;
+    double matchabilityThreshold;
+    size_t matchabilityHistory;
+    std::deque<MatchabilityChecker::Scan> recentScans;
+    MatchabilityChecker::Scan lastAnchorScan;
+
+    // Cloud recording pipeline.
+    boost::scoped_ptr<WorkerPool> recordingPool;
+    bool waitForRecording;
+    unsigned int skippedClouds;
+    boost::atomic<unsigned int> recordedClouds;
+    boost::atomic<uint64_t> recordingMicroseconds;
+
+    // Recording statistics since the last TeachStats.
+    unsigned int windowSkipped;
+    boost::atomic<unsigned int> windowRecorded;
+    LatencyHistogram recordingLatency;
+
+    // Path recording information.
+    int nextCloudIndex;
+    ros::Time teachingStartTime;
+    std::map<ros::Time, AnchorPoint> anchorPointList;  // By stamp of the scan.
+    geometry_msgs::Pose lastOdomPosition;
+
+    ros::Subscriber cloudTopic;
+    ros::Subscriber joystickTopic;
+    ros::Subscriber poseTopic;
+    ros::Subscriber velocityTopic;
+    ros::Subscriber recorderStatusTopic;
+    ros::Publisher cloudRecorderTopic;
+    ros::Publisher compressedCloudRecorderTopic;
+    ros::Publisher matchabilityTopic;
+    ros::Publisher statsTopic;
+    ros::Timer statsTimer;
+
+    std::string pathOf(const std::string& filename) const;
+    void saveAnchorPointList();
+    void recordCloud(const sensor_msgs::PointCloud2ConstPtr& msg, const std::string& name);
+    std::string insertedAnchorName(const ros::Time& stamp) const;
+    bool addAnchorPoint(const sensor_msgs::PointCloud2ConstPtr& msg, const geometry_msgs::Pose& pose,
+                        bool inserted, std::string& name);
+    bool recordAnchorPoint(const sensor_msgs::PointCloud2ConstPtr& msg, const geometry_msgs::Pose& pose);
+    bool handleMatchabilityResults();
+
+    void cloudCallback(const sensor_msgs::PointCloud2ConstPtr& msg);
+    void joystickCallback(const sensor_msgs::Joy::ConstPtr& joy);
+    void odomCallback(const nav_msgs::Odometry::ConstPtr& msg);
+    void velocityCallback(const geometry_msgs::Twist::ConstPtr& msg);
+    void recorderStatusCallback(const husky_trainer::RecorderStatus::ConstPtr& msg);
+    void setRecorderBehind(bool behind);
+    void statsCallback(const ros::TimerEvent& event);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <stdint.h>
+
+// Scoped spans for profiling, written as Chrome trace events (viewable in
+// chrome://tracing or Perfetto). The macros compile to nothing unless the
+// package is built with -DHUSKY_TRAINER_TRACING=ON.
+//
+//   void Teach::cloudCallback(...)
+//   {
+//       TRACE_SPAN("Teach::cloudCallback");
+//       ...
+//   }
+//
+// Every thread records its spans in its own fixed size buffer, without
+// locking. A full buffer drops the spans that follow. The buffers belong to
+// the process, not to a node: nodelets loaded in the same manager run on the
+// same threads, so a dump holds the spans of all of them. Tell them apart by
+// the names of the spans.
+#ifdef HUSKY_TRAINER_TRACING
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_DUMP(filename) trace::dump(filename)
+
+namespace trace
+{
+
+// The name must outlive the trace, a string literal for instance.
+class Span {
+public:
+    explicit Span(const char* name);
+    ~Span();
+
+private:
+    const char* mName;
+    uint64_t mStart;
+};
+
+bool dump(const std::string& filename);
+}
+
+#else
+
+#define TRACE_SPAN(name) do { } while(0)
+#define TRACE_DUMP(filename) do { } while(0)
+
+#endif
+
+#endif
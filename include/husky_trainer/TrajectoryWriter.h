@@ -0,0 +1,52 @@
+#ifndef TRAJECTORY_WRITER_H
+#define TRAJECTORY_WRITER_H
+
+#include <cstdio>
+#include <string>
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread.hpp>
+
+#include <geometry_msgs/Pose.h>
+
+// Writes the positions and commands of a teach from a background thread. The
+// callbacks only push a fixed size record on a lock free ring buffer, the
+// formatting and the writes happen on the writer thread, in batches. There
+// must be a single thread recording, which is the case with ros::spinOnce.
+// Records are dropped if the ring buffer is full.
+class TrajectoryWriter {
+public:
+    TrajectoryWriter(const std::string& positionsFile, const std::string& commandsFile,
+                     size_t capacity);
+    ~TrajectoryWriter();
+
+    bool isOpen() const;
+    bool recordPosition(double time, const geometry_msgs::Pose& pose);
+    bool recordCommand(double time, double linear, double angular);
+
+    uint64_t droppedCount() const;
+
+private:
+    enum RecordType { POSITION, COMMAND };
+
+    struct Record {
+        RecordType type;
+        double time;
+        double values[7];
+    };
+
+    FILE* mPositionsFile;
+    FILE* mCommandsFile;
+    boost::lockfree::spsc_queue<Record> mQueue;
+    boost::atomic<bool> mStopping;
+    boost::atomic<uint64_t> mDropped;
+    boost::thread mThread;
+
+    bool push(const Record& record);
+    void work();
+    size_t drain(std::string& positions, std::string& commands);
+};
+
+#endif
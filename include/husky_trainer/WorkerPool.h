@@ -0,0 +1,42 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <deque>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// A fixed number of threads serving a bounded queue of jobs. The destructor
+// runs the jobs that are still queued before joining the threads.
+class WorkerPool {
+public:
+    typedef boost::function<void()> Job;
+
+    WorkerPool(unsigned int threadCount, size_t capacity);
+    ~WorkerPool();
+
+    bool tryPost(const Job& job);
+    void post(const Job& job);
+    void waitUntilIdle();
+
+    size_t pendingCount();
+    size_t capacity() const;
+    unsigned int threadCount() const;
+
+private:
+    size_t mCapacity;
+    size_t mActiveJobs;
+    bool mStopping;
+    std::deque<Job> mJobs;
+    boost::mutex mMutex;
+    boost::condition_variable mJobAvailable;
+    boost::condition_variable mSpaceAvailable;
+    boost::condition_variable mIdle;
+    boost::thread_group mThreads;
+
+    void work();
+};
+
+#endif
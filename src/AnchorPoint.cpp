@@ -1,25 +1,29 @@
 
 #include "husky_trainer/AnchorPoint.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/CloudPreparation.h"
+#include "husky_trainer/CloudIO.h"
 
 #define SCAN_RADIUS_BALLPARK 10.0
 
 const std::string AnchorPoint::POINT_CLOUD_FRAME = "/odom";
 
-AnchorPoint::AnchorPoint() : mPointCloud()
+AnchorPoint::AnchorPoint() : mPointCloud(), mPrepared(false)
 { }
 
 AnchorPoint::AnchorPoint(std::string& anchorPointName, geometry_msgs::Pose position) :
-    mAnchorPointName(anchorPointName), mPointCloud(), mPosition(position)
+    mAnchorPointName(anchorPointName), mPointCloud(), mPosition(position), mPrepared(false)
 { }
 
 AnchorPoint::AnchorPoint(std::string& anchorPointName, 
         geometry_msgs::Pose position, sensor_msgs::PointCloud2 cloud) :
-    mAnchorPointName(anchorPointName), mPointCloud(cloud), mPosition(position)
+    mAnchorPointName(anchorPointName), mPointCloud(cloud), mPosition(position), mPrepared(false)
 { }
 
 
 // Builds an anchor point from a string, as in the format outputted by the << operator.
-AnchorPoint::AnchorPoint(std::string& anchorPointEntry)
+AnchorPoint::AnchorPoint(std::string& anchorPointEntry) :
+    mPrepared(false)
 {
     std::stringstream ss(anchorPointEntry);
     std::string buffer;
@@ -46,10 +50,51 @@ sensor_msgs::PointCloud2 AnchorPoint::getCloud() const
     return mPointCloud;
 }
 
+// Whether the cloud went through the preparation filters during the teach.
+bool AnchorPoint::isPrepared() const
+{
+    return mPrepared;
+}
+
 
 void AnchorPoint::loadFromDisk()
 {
-    PointMatcher<float>::DataPoints pointCloudBuffer = PointMatcherIO<float>::loadVTK(mAnchorPointName);
+    loadFromDisk("");
+}
+
+// Load the cloud of the anchor point, looking for it in the given directory.
+// The cloud prepared during the teach is used if there is one, unless the
+// cloud was written again since.
+void AnchorPoint::loadFromDisk(const std::string& directory)
+{
+    std::string filename = RouteLibrary::joinPath(directory, mAnchorPointName);
+    mPrepared = CloudPreparation::isCurrent(filename) &&
+        CloudPreparation::load(CloudPreparation::preparedFileOf(filename), mPointCloud);
+    if(mPrepared)
+    {
+        mPointCloud.header.frame_id = POINT_CLOUD_FRAME;
+        mPointCloud.header.stamp = ros::Time(0);
+        return;
+    }
+
+    // The cloud recorder may have saved the cloud as a binary PCD, whatever
+    // the extension of the anchor point.
+    if(cloud_io::isPcd(filename))
+    {
+        if(cloud_io::readPcd(filename, mPointCloud))
+        {
+            mPointCloud.header.frame_id = POINT_CLOUD_FRAME;
+            mPointCloud.header.stamp = ros::Time(0);
+            return;
+        }
+
+        PointMatcher<float>::DataPoints pointCloudBuffer = PointMatcherIO<float>::loadPCD(filename);
+        mPointCloud = PointMatcher_ros::pointMatcherCloudToRosMsg<float>(pointCloudBuffer, POINT_CLOUD_FRAME, ros::Time(0));
+        return;
+    }
+
+    PointMatcher<float>::DataPoints pointCloudBuffer =
+        PointMatcherIO<float>::loadVTK(filename);
     mPointCloud = PointMatcher_ros::pointMatcherCloudToRosMsg<float>(pointCloudBuffer, POINT_CLOUD_FRAME, ros::Time(0));
 }
 
@@ -0,0 +1,46 @@
+
+#include <cmath>
+
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/AnchorSelector.h"
+
+AnchorSelector::AnchorSelector(double distance, double angle) :
+    mDistance(distance), mAngle(angle), mLastAnchor()
+{ }
+
+bool AnchorSelector::isNewAnchor(const geometry_msgs::Pose& pose) const
+{
+    return fabs(distanceSinceAnchor(pose)) > mDistance ||
+           fabs(angleSinceAnchor(pose)) > mAngle;
+}
+
+void AnchorSelector::setLastAnchor(const geometry_msgs::Pose& pose)
+{
+    mLastAnchor = pose;
+}
+
+void AnchorSelector::setSpacing(double distance, double angle)
+{
+    mDistance = distance;
+    mAngle = angle;
+}
+
+double AnchorSelector::distanceSinceAnchor(const geometry_msgs::Pose& pose) const
+{
+    return geo_util::euclidian_distance_of_poses(pose, mLastAnchor);
+}
+
+double AnchorSelector::angleSinceAnchor(const geometry_msgs::Pose& pose) const
+{
+    return geo_util::angle_between_poses(pose, mLastAnchor);
+}
+
+double AnchorSelector::distance() const
+{
+    return mDistance;
+}
+
+double AnchorSelector::angle() const
+{
+    return mAngle;
+}
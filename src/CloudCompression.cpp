@@ -0,0 +1,261 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+#include "husky_trainer/CloudCompression.h"
+
+#define COMPRESSION_LEVEL 3
+#define SIZE_PREFIX_LENGTH 4
+
+namespace cloud_compression
+{
+
+namespace
+{
+
+uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+void writeVarint(uint32_t value, std::vector<uint8_t>& out)
+{
+    while(value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool readVarint(const std::vector<uint8_t>& in, size_t& cursor, uint32_t& value)
+{
+    value = 0;
+    for(int shift = 0; shift < 35 && cursor < in.size(); shift += 7)
+    {
+        uint8_t byte = in[cursor++];
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+int32_t quantize(float value, float resolution)
+{
+    double q = std::floor(value / resolution + 0.5);
+    q = std::max(q, static_cast<double>(std::numeric_limits<int32_t>::min() / 2));
+    q = std::min(q, static_cast<double>(std::numeric_limits<int32_t>::max() / 2));
+    return static_cast<int32_t>(q);
+}
+
+}
+
+// The points must be packed as consecutive xyz triplets. Non finite points
+// are not expected here, extractPoints already drops them.
+bool encodePoints(const std::vector<float>& xyz, float resolution, std::vector<uint8_t>& out)
+{
+    if(resolution <= 0.0 || xyz.size() % 3 != 0) return false;
+
+    std::vector<uint8_t> varints;
+    varints.reserve(xyz.size() * 2);
+
+    int32_t previous[3] = {0, 0, 0};
+    for(size_t i = 0; i < xyz.size(); i += 3)
+    {
+        for(int axis = 0; axis < 3; axis++)
+        {
+            int32_t q = quantize(xyz[i + axis], resolution);
+            writeVarint(zigzag(q - previous[axis]), varints);
+            previous[axis] = q;
+        }
+    }
+
+    uLongf deflatedSize = compressBound(varints.size());
+    out.resize(SIZE_PREFIX_LENGTH + deflatedSize);
+
+    uint32_t rawSize = varints.size();
+    for(int i = 0; i < SIZE_PREFIX_LENGTH; i++)
+    {
+        out[i] = static_cast<uint8_t>(rawSize >> (8 * i));
+    }
+
+    if(compress2(&out[SIZE_PREFIX_LENGTH], &deflatedSize,
+                 varints.empty() ? NULL : &varints[0], varints.size(),
+                 COMPRESSION_LEVEL) != Z_OK)
+    {
+        return false;
+    }
+
+    out.resize(SIZE_PREFIX_LENGTH + deflatedSize);
+    return true;
+}
+
+bool decodePoints(const std::vector<uint8_t>& data, float resolution,
+                  uint32_t pointCount, std::vector<float>& xyz)
+{
+    if(data.size() < SIZE_PREFIX_LENGTH) return false;
+
+    uint32_t rawSize = 0;
+    for(int i = 0; i < SIZE_PREFIX_LENGTH; i++)
+    {
+        rawSize |= static_cast<uint32_t>(data[i]) << (8 * i);
+    }
+
+    // Every coordinate takes at least one byte and at most five.
+    if(rawSize < 3 * static_cast<uint64_t>(pointCount) ||
+       rawSize > 15 * static_cast<uint64_t>(pointCount))
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> varints(rawSize);
+    uLongf inflatedSize = rawSize;
+    if(rawSize > 0 &&
+       (uncompress(&varints[0], &inflatedSize,
+                   &data[SIZE_PREFIX_LENGTH], data.size() - SIZE_PREFIX_LENGTH) != Z_OK ||
+        inflatedSize != rawSize))
+    {
+        return false;
+    }
+
+    xyz.resize(3 * static_cast<size_t>(pointCount));
+
+    size_t cursor = 0;
+    int32_t previous[3] = {0, 0, 0};
+    for(size_t i = 0; i < xyz.size(); i += 3)
+    {
+        for(int axis = 0; axis < 3; axis++)
+        {
+            uint32_t delta;
+            if(!readVarint(varints, cursor, delta)) return false;
+
+            previous[axis] += unzigzag(delta);
+            xyz[i + axis] = previous[axis] * resolution;
+        }
+    }
+
+    return cursor == varints.size();
+}
+
+bool extractPoints(const sensor_msgs::PointCloud2& cloud, std::vector<float>& xyz)
+{
+    const std::string axisNames[] = {"x", "y", "z"};
+    int offsets[3] = {-1, -1, -1};
+
+    for(size_t i = 0; i < cloud.fields.size(); i++)
+    {
+        for(int axis = 0; axis < 3; axis++)
+        {
+            if(cloud.fields[i].name == axisNames[axis] &&
+               cloud.fields[i].datatype == sensor_msgs::PointField::FLOAT32)
+            {
+                offsets[axis] = cloud.fields[i].offset;
+            }
+        }
+    }
+
+    if(offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0 || cloud.is_bigendian)
+    {
+        return false;
+    }
+
+    // Every point must be inside of the buffer, whatever the header says.
+    int pointEnd = std::max(offsets[0], std::max(offsets[1], offsets[2])) + static_cast<int>(sizeof(float));
+    size_t rowLength = static_cast<size_t>(cloud.width) * cloud.point_step;
+    if(cloud.width > 0 && cloud.height > 0 &&
+       (cloud.point_step < static_cast<uint32_t>(pointEnd) || cloud.row_step < rowLength ||
+        cloud.data.size() < static_cast<size_t>(cloud.row_step) * (cloud.height - 1) + rowLength))
+    {
+        return false;
+    }
+
+    xyz.clear();
+    xyz.reserve(3 * static_cast<size_t>(cloud.width) * cloud.height);
+
+    for(uint32_t row = 0; row < cloud.height; row++)
+    {
+        for(uint32_t col = 0; col < cloud.width; col++)
+        {
+            const uint8_t* point =
+                &cloud.data[static_cast<size_t>(row) * cloud.row_step + static_cast<size_t>(col) * cloud.point_step];
+
+            float coordinates[3];
+            for(int axis = 0; axis < 3; axis++)
+            {
+                std::memcpy(&coordinates[axis], point + offsets[axis], sizeof(float));
+            }
+
+            if(std::isfinite(coordinates[0]) && std::isfinite(coordinates[1]) &&
+               std::isfinite(coordinates[2]))
+            {
+                xyz.insert(xyz.end(), coordinates, coordinates + 3);
+            }
+        }
+    }
+
+    return true;
+}
+
+sensor_msgs::PointCloud2 cloudOfPoints(const std::vector<float>& xyz, const std_msgs::Header& header)
+{
+    sensor_msgs::PointCloud2 cloud;
+    cloud.header = header;
+    cloud.height = 1;
+    cloud.width = xyz.size() / 3;
+    cloud.is_bigendian = false;
+    cloud.is_dense = true;
+    cloud.point_step = 3 * sizeof(float);
+    cloud.row_step = cloud.point_step * cloud.width;
+
+    const std::string axisNames[] = {"x", "y", "z"};
+    for(int axis = 0; axis < 3; axis++)
+    {
+        sensor_msgs::PointField field;
+        field.name = axisNames[axis];
+        field.offset = axis * sizeof(float);
+        field.datatype = sensor_msgs::PointField::FLOAT32;
+        field.count = 1;
+        cloud.fields.push_back(field);
+    }
+
+    cloud.data.resize(xyz.size() * sizeof(float));
+    if(!xyz.empty())
+    {
+        std::memcpy(&cloud.data[0], &xyz[0], cloud.data.size());
+    }
+
+    return cloud;
+}
+
+bool compress(const std::string& name, const sensor_msgs::PointCloud2& cloud, float resolution,
+              husky_trainer::CompressedNamedPointCloud& out)
+{
+    std::vector<float> xyz;
+    if(!extractPoints(cloud, xyz)) return false;
+
+    out.name = name;
+    out.header = cloud.header;
+    out.resolution = resolution;
+    out.point_count = xyz.size() / 3;
+
+    return encodePoints(xyz, resolution, out.data);
+}
+
+bool decompress(const husky_trainer::CompressedNamedPointCloud& msg, sensor_msgs::PointCloud2& out)
+{
+    std::vector<float> xyz;
+    if(!decodePoints(msg.data, msg.resolution, msg.point_count, xyz)) return false;
+
+    out = cloudOfPoints(xyz, msg.header);
+    return true;
+}
+
+}
@@ -0,0 +1,383 @@
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "husky_trainer/CloudIO.h"
+
+#define PCD_MAGIC "# .PCD"
+#define PADDING_FIELD "_"
+#define DIRECT_IO_ALIGNMENT 4096
+#define MAX_ROW_LENGTH 0xffffffffULL  // row_step is 32 bits.
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace cloud_io
+{
+
+namespace
+{
+
+bool typeOfDatatype(uint8_t datatype, int& size, char& type)
+{
+    switch(datatype)
+    {
+    case sensor_msgs::PointField::INT8:    size = 1; type = 'I'; return true;
+    case sensor_msgs::PointField::UINT8:   size = 1; type = 'U'; return true;
+    case sensor_msgs::PointField::INT16:   size = 2; type = 'I'; return true;
+    case sensor_msgs::PointField::UINT16:  size = 2; type = 'U'; return true;
+    case sensor_msgs::PointField::INT32:   size = 4; type = 'I'; return true;
+    case sensor_msgs::PointField::UINT32:  size = 4; type = 'U'; return true;
+    case sensor_msgs::PointField::FLOAT32: size = 4; type = 'F'; return true;
+    case sensor_msgs::PointField::FLOAT64: size = 8; type = 'F'; return true;
+    default: return false;
+    }
+}
+
+bool datatypeOfType(int size, char type, uint8_t& datatype)
+{
+    for(uint8_t candidate = sensor_msgs::PointField::INT8;
+        candidate <= sensor_msgs::PointField::FLOAT64; candidate++)
+    {
+        int candidateSize;
+        char candidateType;
+        typeOfDatatype(candidate, candidateSize, candidateType);
+        if(candidateSize == size && candidateType == type)
+        {
+            datatype = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool byOffset(const sensor_msgs::PointField& a, const sensor_msgs::PointField& b)
+{
+    return a.offset < b.offset;
+}
+
+// Writes everything, going on after partial writes.
+bool writeAll(int fd, std::vector<iovec>& iov)
+{
+    size_t first = 0;
+    while(first < iov.size())
+    {
+        int count = std::min<size_t>(iov.size() - first, IOV_MAX);
+        ssize_t written = writev(fd, &iov[first], count);
+        if(written < 0)
+        {
+            if(errno == EINTR) continue;
+            return false;
+        }
+
+        while(first < iov.size() && static_cast<size_t>(written) >= iov[first].iov_len)
+        {
+            written -= iov[first].iov_len;
+            first++;
+        }
+        if(written > 0)
+        {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + written;
+            iov[first].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// O_DIRECT wants aligned buffers and lengths, so the file goes through an
+// aligned copy and is cut back to its size afterwards.
+bool writeDirect(int fd, const std::vector<iovec>& iov)
+{
+    size_t length = 0;
+    for(size_t i = 0; i < iov.size(); i++) length += iov[i].iov_len;
+
+    size_t alignedLength = (length + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    void* buffer;
+    if(posix_memalign(&buffer, DIRECT_IO_ALIGNMENT, std::max<size_t>(alignedLength, DIRECT_IO_ALIGNMENT)) != 0)
+    {
+        return false;
+    }
+
+    char* cursor = static_cast<char*>(buffer);
+    for(size_t i = 0; i < iov.size(); i++)
+    {
+        memcpy(cursor, iov[i].iov_base, iov[i].iov_len);
+        cursor += iov[i].iov_len;
+    }
+    memset(cursor, 0, alignedLength - length);
+
+    std::vector<iovec> aligned(1);
+    aligned[0].iov_base = buffer;
+    aligned[0].iov_len = alignedLength;
+    bool written = writeAll(fd, aligned) && ftruncate(fd, length) == 0;
+
+    free(buffer);
+    return written;
+}
+
+}
+
+// Gaps between the fields are declared as padding, which PCL skips.
+std::string pcdHeader(const sensor_msgs::PointCloud2& cloud)
+{
+    std::vector<sensor_msgs::PointField> fields(cloud.fields);
+    std::sort(fields.begin(), fields.end(), byOffset);
+
+    std::ostringstream names, sizes, types, counts;
+    uint32_t offset = 0;
+    for(size_t i = 0; i <= fields.size(); i++)
+    {
+        uint32_t next = i < fields.size() ? fields[i].offset : cloud.point_step;
+        if(next > offset)
+        {
+            names << " " << PADDING_FIELD;
+            sizes << " 1";
+            types << " U";
+            counts << " " << next - offset;
+        }
+        if(i == fields.size()) break;
+        if(fields[i].offset < offset) return "";
+
+        int size;
+        char type;
+        if(!typeOfDatatype(fields[i].datatype, size, type)) return "";
+
+        uint32_t count = std::max<uint32_t>(fields[i].count, 1);
+        names << " " << fields[i].name;
+        sizes << " " << size;
+        types << " " << type;
+        counts << " " << count;
+        offset = fields[i].offset + size * count;
+    }
+
+    std::ostringstream header;
+    header << PCD_MAGIC << " v0.7 - Point Cloud Data file format\n" <<
+        "VERSION 0.7\n" <<
+        "FIELDS" << names.str() << "\n" <<
+        "SIZE" << sizes.str() << "\n" <<
+        "TYPE" << types.str() << "\n" <<
+        "COUNT" << counts.str() << "\n" <<
+        "WIDTH " << cloud.width << "\n" <<
+        "HEIGHT " << cloud.height << "\n" <<
+        "VIEWPOINT 0 0 0 1 0 0 0\n" <<
+        "POINTS " << static_cast<uint64_t>(cloud.width) * cloud.height << "\n" <<
+        "DATA binary\n";
+    return header.str();
+}
+
+// Written to a temporary file first, a reader never finds half a cloud.
+bool writePcd(const std::string& filename, const sensor_msgs::PointCloud2& cloud, bool directIo)
+{
+    if(cloud.is_bigendian) return false;
+
+    std::string header = pcdHeader(cloud);
+    if(header.empty()) return false;
+
+    size_t rowLength = static_cast<size_t>(cloud.width) * cloud.point_step;
+    if(cloud.height > 0 && (cloud.row_step < rowLength ||
+                            cloud.data.size() < static_cast<size_t>(cloud.row_step) * (cloud.height - 1) + rowLength))
+    {
+        return false;
+    }
+
+    std::vector<iovec> iov(1);
+    iov[0].iov_base = const_cast<char*>(header.data());
+    iov[0].iov_len = header.size();
+
+    // Rows without padding between them go out as one block.
+    if(cloud.row_step == rowLength)
+    {
+        iovec data;
+        data.iov_base = const_cast<uint8_t*>(cloud.data.empty() ? NULL : &cloud.data[0]);
+        data.iov_len = rowLength * cloud.height;
+        iov.push_back(data);
+    }
+    else
+    {
+        for(uint32_t row = 0; row < cloud.height; row++)
+        {
+            iovec data;
+            data.iov_base = const_cast<uint8_t*>(&cloud.data[static_cast<size_t>(row) * cloud.row_step]);
+            data.iov_len = rowLength;
+            iov.push_back(data);
+        }
+    }
+
+    std::string temporary = filename + ".tmp";
+    int fd = -1;
+#ifdef O_DIRECT
+    if(directIo) fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+#endif
+    bool written = false;
+    if(fd >= 0)
+    {
+        written = writeDirect(fd, iov);
+        written = close(fd) == 0 && written;
+    }
+
+    // Not every file system takes O_DIRECT, some only refuse it on the write
+    // (EINVAL), so the buffered write is tried again after any failure.
+    if(!written)
+    {
+        fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) return false;
+
+        written = writeAll(fd, iov);
+        written = close(fd) == 0 && written;
+    }
+
+    if(!written || rename(temporary.c_str(), filename.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool isPcd(const std::string& filename)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == NULL) return false;
+
+    char start[sizeof(PCD_MAGIC) - 1];
+    bool pcd = fread(start, 1, sizeof(start), file) == sizeof(start) &&
+        memcmp(start, PCD_MAGIC, sizeof(start)) == 0;
+    fclose(file);
+    return pcd;
+}
+
+// Only reads binary PCD files. The size of the cloud given by the header is
+// checked against the size of the file before anything is allocated.
+bool readPcd(const std::string& filename, sensor_msgs::PointCloud2& cloud)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == NULL) return false;
+
+    std::vector<std::string> names;
+    std::vector<int> sizes, counts;
+    std::vector<char> types;
+    uint32_t width = 0, height = 0;
+    uint64_t points = 0;
+    bool hasPoints = false;
+    bool binary = false;
+
+    char line[4096];
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        std::istringstream ss(line);
+        std::string keyword;
+        ss >> keyword;
+
+        if(keyword == "FIELDS")
+        {
+            std::string name;
+            while(ss >> name) names.push_back(name);
+        }
+        else if(keyword == "SIZE")
+        {
+            int size;
+            while(ss >> size) sizes.push_back(size);
+        }
+        else if(keyword == "TYPE")
+        {
+            char type;
+            while(ss >> type) types.push_back(type);
+        }
+        else if(keyword == "COUNT")
+        {
+            int count;
+            while(ss >> count) counts.push_back(count);
+        }
+        else if(keyword == "WIDTH") ss >> width;
+        else if(keyword == "HEIGHT") ss >> height;
+        else if(keyword == "POINTS")
+        {
+            ss >> points;
+            hasPoints = !ss.fail();
+        }
+        else if(keyword == "DATA")
+        {
+            std::string format;
+            ss >> format;
+            binary = format == "binary";
+            break;
+        }
+    }
+
+    if(counts.empty()) counts.assign(names.size(), 1);
+    if(!binary || names.empty() || sizes.size() != names.size() || types.size() != names.size() ||
+       counts.size() != names.size())
+    {
+        fclose(file);
+        return false;
+    }
+
+    cloud.fields.clear();
+    uint64_t offset = 0;
+    for(size_t i = 0; i < names.size(); i++)
+    {
+        if(sizes[i] <= 0 || counts[i] <= 0 || offset > MAX_ROW_LENGTH)
+        {
+            fclose(file);
+            return false;
+        }
+
+        if(names[i] != PADDING_FIELD)
+        {
+            sensor_msgs::PointField field;
+            field.name = names[i];
+            field.offset = offset;
+            field.count = counts[i];
+            if(!datatypeOfType(sizes[i], types[i], field.datatype))
+            {
+                fclose(file);
+                return false;
+            }
+            cloud.fields.push_back(field);
+        }
+        offset += static_cast<uint64_t>(sizes[i]) * counts[i];
+    }
+
+    // A row has to fit in row_step, and the points have to be in the file.
+    uint64_t rowLength = static_cast<uint64_t>(width) * offset;
+    if(offset > MAX_ROW_LENGTH || rowLength > MAX_ROW_LENGTH ||
+       (hasPoints && points != static_cast<uint64_t>(width) * height))
+    {
+        fclose(file);
+        return false;
+    }
+
+    long start = ftell(file);
+    long end = start >= 0 && fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if(end < start || static_cast<uint64_t>(end - start) < rowLength * height ||
+       fseek(file, start, SEEK_SET) != 0)
+    {
+        fclose(file);
+        return false;
+    }
+
+    cloud.width = width;
+    cloud.height = height;
+    cloud.point_step = offset;
+    cloud.row_step = width * offset;
+    cloud.is_bigendian = false;
+    cloud.is_dense = false;
+    cloud.data.resize(static_cast<size_t>(cloud.row_step) * height);
+
+    bool read = cloud.data.empty() || fread(&cloud.data[0], 1, cloud.data.size(), file) == cloud.data.size();
+    fclose(file);
+    return read;
+}
+
+}
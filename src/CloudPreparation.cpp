@@ -0,0 +1,114 @@
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <ros/ros.h>
+#include <ros/serialization.h>
+
+#include "husky_trainer/CloudPreparation.h"
+
+const std::string CloudPreparation::PREPARED_SUFFIX = ".prep";
+
+CloudPreparation::CloudPreparation() :
+    mFilterConfig()
+{ }
+
+bool CloudPreparation::loadFilters(const std::string& filename)
+{
+    std::ifstream file(filename.c_str());
+    if(!file.is_open()) return false;
+
+    std::stringstream ss;
+    ss << file.rdbuf();
+    mFilterConfig = ss.str();
+
+    // Fail now rather than on the first cloud if the config is wrong.
+    try {
+        std::istringstream config(mFilterConfig);
+        PointMatcher<float>::DataPointsFilters filters(config);
+    } catch(std::exception& e) {
+        ROS_ERROR_STREAM("Could not load the preparation filters: " << e.what());
+        mFilterConfig.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void CloudPreparation::prepare(PointMatcher<float>::DataPoints& cloud) const
+{
+    if(mFilterConfig.empty()) return;
+
+    std::istringstream config(mFilterConfig);
+    PointMatcher<float>::DataPointsFilters filters(config);
+    filters.apply(cloud);
+}
+
+std::string CloudPreparation::preparedFileOf(const std::string& cloudFile)
+{
+    return cloudFile + PREPARED_SUFFIX;
+}
+
+// Whether the cloud has a prepared cloud written after it. Without the cloud
+// itself, the prepared one is all there is.
+bool CloudPreparation::isCurrent(const std::string& cloudFile)
+{
+    boost::system::error_code error;
+    std::time_t preparedTime = boost::filesystem::last_write_time(preparedFileOf(cloudFile), error);
+    if(error) return false;
+
+    std::time_t cloudTime = boost::filesystem::last_write_time(cloudFile, error);
+    return error || preparedTime >= cloudTime;
+}
+
+// Written to a temporary file first, so that a repeat never finds half a
+// prepared cloud.
+bool CloudPreparation::save(const std::string& filename, const sensor_msgs::PointCloud2& cloud)
+{
+    uint32_t length = ros::serialization::serializationLength(cloud);
+    std::vector<uint8_t> buffer(length);
+    ros::serialization::OStream stream(&buffer[0], length);
+    ros::serialization::serialize(stream, cloud);
+
+    std::string temporary = filename + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if(file == NULL) return false;
+
+    bool written = fwrite(&buffer[0], 1, length, file) == length;
+    written = fclose(file) == 0 && written;
+
+    return written && rename(temporary.c_str(), filename.c_str()) == 0;
+}
+
+bool CloudPreparation::load(const std::string& filename, sensor_msgs::PointCloud2& cloud)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == NULL) return false;
+
+    std::vector<uint8_t> buffer;
+    if(fseek(file, 0, SEEK_END) == 0)
+    {
+        long size = ftell(file);
+        if(size > 0 && fseek(file, 0, SEEK_SET) == 0)
+        {
+            buffer.resize(size);
+            if(fread(&buffer[0], 1, size, file) != static_cast<size_t>(size)) buffer.clear();
+        }
+    }
+    fclose(file);
+
+    if(buffer.empty()) return false;
+
+    try {
+        ros::serialization::IStream stream(&buffer[0], buffer.size());
+        ros::serialization::deserialize(stream, cloud);
+    } catch(ros::serialization::StreamOverrunException& e) {
+        return false;
+    }
+
+    return true;
+}
@@ -1,30 +1,114 @@
 
+#include <algorithm>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+
+#include "pointmatcher_ros/point_cloud.h"
+
 #include "husky_trainer/CloudRecorder.h"
+#include "husky_trainer/Trace.h"
+
+namespace
+{
 
-CloudRecorder::CloudRecorder(ros::NodeHandle n)
+// The anchor points are numbered by the teach, -1 if the name has no number.
+// Inserted anchor points carry the number of the one before them.
+long indexOfName(const std::string& name)
+{
+    const char* start = name.c_str();
+    char* end;
+    long index = strtol(start, &end, 10);
+    return end == start ? -1 : index;
+}
+
+void syncFile(const std::string& filename, int flags)
+{
+    int fd = open(filename.c_str(), flags);
+    if(fd < 0) return;
+    if(fsync(fd) != 0)
+    {
+        ROS_WARN_STREAM("Could not sync " << filename << " to disk.");
+    }
+    close(fd);
+}
+
+}
+
+CloudRecorder::CloudRecorder(ros::NodeHandle n) :
+    syncBatch(DEFAULT_SYNC_BATCH), staticTransform(false), transformTimeout(DEFAULT_TRANSFORM_TIMEOUT),
+    backpressure(false), receivedClouds(0), lastStatusTime(ros::WallTime::now()), lastWrittenClouds(0),
+    lastWrittenBytes(0), writtenClouds(0), failedClouds(0), writtenBytes(0)
 {
     std::string publisherTopicName;
     std::string sourceTopicName;
+    std::string compressedSourceTopicName;
     republish = false;
 
-    std::string workingDirectory;
+    std::string routeLibraryRoot, routeName, prepFilters;
+    int writerThreads, writeQueue, batch;
+    double timeout;
     n.getParam(WORKING_DIRECTORY_PARAM, workingDirectory);
+    n.getParam(ROUTE_LIBRARY_PARAM, routeLibraryRoot);
+    n.getParam(ROUTE_NAME_PARAM, routeName);
+    n.param<int>(WRITER_THREADS_PARAM, writerThreads, DEFAULT_WRITER_THREADS);
+    n.param<int>(WRITE_QUEUE_PARAM, writeQueue, DEFAULT_WRITE_QUEUE);
+    n.param<int>(SYNC_BATCH_PARAM, batch, DEFAULT_SYNC_BATCH);
+    syncBatch = std::max(batch, 1);
+    n.param<bool>(STATIC_TRANSFORM_PARAM, staticTransform, false);
+    n.param<double>(TRANSFORM_TIMEOUT_PARAM, timeout, DEFAULT_TRANSFORM_TIMEOUT);
+    transformTimeout = ros::Duration(timeout);
+    n.param<bool>(DIRECT_IO_PARAM, directIo, false);
+    n.param<bool>(PREPARE_ANCHOR_POINTS_PARAM, prepareClouds, false);
+    n.getParam(PREP_FILTERS_PARAM, prepFilters);
+
+    if(prepareClouds && !prepFilters.empty() && !preparation.loadFilters(prepFilters))
+    {
+        ROS_WARN_STREAM("Could not load " << prepFilters << ", the anchor points will be prepared unfiltered.");
+    }
+
+    // When recording a new route in a library, the route directory does not
+    // exist yet.
+    if(!routeLibraryRoot.empty() && !routeName.empty())
+    {
+        workingDirectory = RouteLibrary(routeLibraryRoot).routeDirectory(routeName);
+        boost::system::error_code error;
+        boost::filesystem::create_directories(workingDirectory, error);
+    }
 
-    if(chdir(workingDirectory.c_str()) != 0)
+    // The clouds are saved relative to the working directory rather than
+    // after a chdir, other nodelets may share the process.
+    if(!workingDirectory.empty() && !boost::filesystem::is_directory(workingDirectory))
     {
         ROS_WARN("Could not switch to demanded directory. Using CWD instead.");
-    };
+        workingDirectory = "";
+    }
+
+    writers.reset(new WorkerPool(std::max(writerThreads, 1), std::max(writeQueue, 1)));
 
-    if(!n.getParam(SOURCE_TOPIC_PARAM, sourceTopicName))
+    bool hasSource = n.getParam(SOURCE_TOPIC_PARAM, sourceTopicName);
+    bool hasCompressedSource = n.getParam(COMPRESSED_SOURCE_TOPIC_PARAM, compressedSourceTopicName);
+
+    if(!hasSource && !hasCompressedSource)
     {
         ROS_ERROR("You must specify a source topic.");
         ros::shutdown();
     }
-    else
+
+    if(hasSource)
     {
         sourceTopic = n.subscribe(sourceTopicName, 100, &CloudRecorder::record, this);
     }
 
+    if(hasCompressedSource)
+    {
+        compressedSourceTopic = n.subscribe(compressedSourceTopicName, 100,
+                                            &CloudRecorder::recordCompressed, this);
+    }
+
     if(!n.getParam(FILE_FORMAT_PARAM, fileFormat))
     {
         fileFormat = DEFAULT_FORMAT;
@@ -48,43 +132,374 @@ CloudRecorder::CloudRecorder(ros::NodeHandle n)
     }
 
     n.param<std::string>(TARGET_FRAME_PARAM, targetFrame, "");
+
+    statusTopic = n.advertise<husky_trainer::RecorderStatus>(STATUS_TOPIC, 10);
+    statusTimer = n.createTimer(ros::Duration(STATUS_PERIOD), &CloudRecorder::statusCallback, this);
+    releaseTimer = n.createTimer(ros::Duration(RELEASE_PERIOD), &CloudRecorder::releaseCallback, this);
 }
 
-void CloudRecorder::record(const husky_trainer::NamedPointCloudConstPtr& msg)
+// The queued clouds are all written and synced before the recorder goes away.
+CloudRecorder::~CloudRecorder()
 {
-    sensor_msgs::PointCloud2 cloud = targetFrame == "" ? msg->cloud : transformToFrame(msg->cloud, targetFrame, tfListener);
+    sourceTopic.shutdown();
+    compressedSourceTopic.shutdown();
+    statusTimer.stop();
+    releaseTimer.stop();
 
-    if(fileFormat == "pcd") saveAsPCD(msg->name, cloud);
-    else if(fileFormat == "vtk") saveAsVTK(msg->name, cloud);
+    // Last chance for the parked clouds, waiting for the writers is fine now.
+    releasePending(true);
+    for(size_t i = 0; i < pendingClouds.size(); i++)
+    {
+        ROS_ERROR_STREAM("No transform to " << targetFrame << " for " << pendingClouds[i].name << ".");
+        countFailure();
+    }
+    pendingClouds.clear();
+
+    writers.reset();
+    syncFiles(unsyncedFiles);
+    unsyncedFiles.clear();
 
-    ROS_INFO_STREAM("Saved point cloud with name: " << msg->name << ".");
+    TRACE_DUMP(RouteLibrary::joinPath(workingDirectory, RECORDER_TRACE_FILE));
+
+    husky_trainer::RecorderStatus summary = status();
+    ROS_INFO_STREAM("Saved " << summary.written << " of " << summary.received << " clouds, "
+                    << summary.write_latency.mean_ms << " ms on average, "
+                    << summary.write_latency.p99_ms << " ms at the 99th percentile.");
+    if(summary.failed > 0)
+    {
+        ROS_ERROR_STREAM("Could not save " << summary.failed << " clouds.");
+    }
+    if(summary.missing > 0)
+    {
+        ROS_ERROR_STREAM(summary.missing << " anchor points never reached the recorder.");
+    }
 }
 
-void CloudRecorder::saveAsPCD(std::string name, const sensor_msgs::PointCloud2 &cloud)
+void CloudRecorder::record(const husky_trainer::NamedPointCloudConstPtr& msg)
 {
-    pcl::PCLPointCloud2 pclCloud;
-    pcl_conversions::toPCL(cloud, pclCloud);
-    pcl::io::savePCDFile(name, pclCloud);
+    PendingCloud pending;
+    pending.name = msg->name;
+    pending.header = msg->cloud.header;
+    pending.cloud = msg;
+    enqueue(pending);
 }
 
-void CloudRecorder::saveAsVTK(std::string name, const sensor_msgs::PointCloud2 &cloud)
+void CloudRecorder::recordCompressed(const husky_trainer::CompressedNamedPointCloudConstPtr& msg)
 {
-    pcl::PCLPointCloud2 pclCloud;
-    pcl_conversions::toPCL(cloud, pclCloud);
-    pcl::io::saveVTKFile(name, pclCloud);
+    PendingCloud pending;
+    pending.name = msg->name;
+    pending.header = msg->header;
+    pending.compressedCloud = msg;
+    enqueue(pending);
 }
 
-sensor_msgs::PointCloud2 CloudRecorder::transformToFrame(const sensor_msgs::PointCloud2& cloud, std::string targetFrame, tf::TransformListener& tf)
+void CloudRecorder::enqueue(const PendingCloud& pending)
 {
-    tf::StampedTransform transform;
+    TRACE_SPAN("CloudRecorder::enqueue");
+    receivedClouds++;
+    long index = indexOfName(pending.name);
+    if(index >= 0) receivedIndices.insert(index);
+
+    pendingClouds.push_back(pending);
+    pendingClouds.back().received = ros::Time::now();
+    releasePending(false);
+}
+
+bool CloudRecorder::needsTransform(const std_msgs::Header& header) const
+{
+    return !targetFrame.empty() && header.frame_id != targetFrame;
+}
+
+// Never waits on tf. A static transform is looked up once per frame, at the
+// latest time available, and reused for every cloud after that.
+bool CloudRecorder::findTransform(const std_msgs::Header& header, tf::StampedTransform& out)
+{
+    if(!needsTransform(header)) return true;
+
     try {
-        tf.waitForTransform(targetFrame, cloud.header.frame_id, cloud.header.stamp, ros::Duration(3.0));
-        tf.lookupTransform(targetFrame, cloud.header.frame_id, cloud.header.stamp, transform);
-    } catch(tf::TransformException &ex) {
-        ROS_WARN_STREAM("Could not find a transform to " << targetFrame << " from "
-                        << cloud.header.frame_id);
+        if(staticTransform)
+        {
+            std::map<std::string, tf::StampedTransform>::const_iterator cached =
+                staticTransforms.find(header.frame_id);
+            if(cached != staticTransforms.end())
+            {
+                out = cached->second;
+                return true;
+            }
+
+            if(!tfListener.canTransform(targetFrame, header.frame_id, ros::Time(0))) return false;
+            tfListener.lookupTransform(targetFrame, header.frame_id, ros::Time(0), out);
+            staticTransforms[header.frame_id] = out;
+            return true;
+        }
+
+        if(!tfListener.canTransform(targetFrame, header.frame_id, header.stamp)) return false;
+        tfListener.lookupTransform(targetFrame, header.frame_id, header.stamp, out);
+    } catch(tf::TransformException& e) {
+        return false;
+    }
+
+    return true;
+}
+
+// Hands the parked clouds whose transform is known to the writers. Without
+// wait, this stops at the first cloud that does not fit in the write queue.
+void CloudRecorder::releasePending(bool wait)
+{
+    TRACE_SPAN("CloudRecorder::releasePending");
+    ros::Time now = ros::Time::now();
+    std::deque<PendingCloud>::iterator it = pendingClouds.begin();
+    while(it != pendingClouds.end())
+    {
+        tf::StampedTransform transform;
+        if(!findTransform(it->header, transform))
+        {
+            if(!wait && now - it->received > transformTimeout)
+            {
+                ROS_ERROR_STREAM("No transform to " << targetFrame << " from " << it->header.frame_id
+                                 << " for " << it->name << ", giving up on it.");
+                countFailure();
+                it = pendingClouds.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+            continue;
+        }
+
+        WorkerPool::Job job = boost::bind(&CloudRecorder::writeCloud, this, *it, transform);
+        if(wait)
+        {
+            writers->post(job);
+        }
+        else if(!writers->tryPost(job))
+        {
+            ROS_WARN_THROTTLE(1.0, "The cloud writers are falling behind, %lu clouds waiting.",
+                              static_cast<unsigned long>(pendingClouds.size()));
+            break;
+        }
+
+        it = pendingClouds.erase(it);
+    }
+
+    if(!wait) updateBackpressure();
+}
+
+// The status goes out right away when the backpressure changes.
+void CloudRecorder::updateBackpressure()
+{
+    size_t depth = writers->pendingCount() + pendingClouds.size();
+    bool full = depth >= writers->capacity();
+    bool drained = depth <= writers->capacity() / 2;
+
+    if((!backpressure && full) || (backpressure && drained))
+    {
+        backpressure = !backpressure;
+        if(backpressure)
+        {
+            ROS_WARN("The cloud recorder is falling behind, asking the teach to slow down.");
+        }
+        statusTopic.publish(status());
+    }
+}
+
+void CloudRecorder::releaseCallback(const ros::TimerEvent& event)
+{
+    releasePending(false);
+}
+
+// Runs on the writer threads.
+void CloudRecorder::writeCloud(const PendingCloud& pending, const tf::StampedTransform& transform)
+{
+    TRACE_SPAN("CloudRecorder::writeCloud");
+    queueLatency.record((ros::Time::now() - pending.received).toNSec() / 1000);
+
+    if(pending.cloud)
+    {
+        saveCloud(pending.name, pending.cloud->cloud, transform);
+        return;
+    }
+
+    sensor_msgs::PointCloud2 cloud;
+    if(!cloud_compression::decompress(*pending.compressedCloud, cloud))
+    {
+        ROS_ERROR_STREAM("Could not decompress point cloud with name: " << pending.name << ".");
+        countFailure();
+        return;
+    }
+
+    saveCloud(pending.name, cloud, transform);
+}
+
+void CloudRecorder::countFailure()
+{
+    boost::mutex::scoped_lock lock(statsMutex);
+    failedClouds++;
+}
+
+void CloudRecorder::saveCloud(const std::string& name, const sensor_msgs::PointCloud2& msgCloud,
+                              const tf::StampedTransform& transform)
+{
+    TRACE_SPAN("CloudRecorder::saveCloud");
+    ros::WallTime startTime = ros::WallTime::now();
+
+    sensor_msgs::PointCloud2 cloud = needsTransform(msgCloud.header) ? transformToFrame(msgCloud, transform) : msgCloud;
+
+    std::string filename = RouteLibrary::joinPath(workingDirectory, name);
+    bool saved = false;
+    if(fileFormat == "pcd") saved = cloud_io::writePcd(filename, cloud, directIo);
+    else if(fileFormat == "vtk") saved = saveAsVTK(filename, cloud);
+
+    writeLatency.record((ros::WallTime::now() - startTime).toNSec() / 1000);
+
+    if(saved)
+    {
+        prepareCloud(filename, cloud);
+    }
+    else
+    {
+        boost::system::error_code error;
+        boost::filesystem::remove(CloudPreparation::preparedFileOf(filename), error);
+    }
+
+    std::vector<std::string> batch;
+    {
+        boost::mutex::scoped_lock lock(statsMutex);
+        if(saved)
+        {
+            writtenClouds++;
+            writtenBytes += cloud.data.size();
+            unsyncedFiles.push_back(filename);
+            if(unsyncedFiles.size() >= syncBatch) batch.swap(unsyncedFiles);
+        }
+        else
+        {
+            failedClouds++;
+        }
     }
 
+    if(saved)
+    {
+        ROS_INFO_STREAM("Saved point cloud with name: " << name << ".");
+    }
+    else
+    {
+        ROS_ERROR_STREAM("Could not save point cloud with name: " << name << ".");
+    }
+
+    syncFiles(batch);
+}
+
+// The prepared cloud is made from the cloud as saved, in the target frame and
+// quantized if it came compressed, and written after it. Otherwise, whatever
+// an earlier teach prepared under the same name is removed, it would shadow
+// the new cloud.
+void CloudRecorder::prepareCloud(const std::string& filename, const sensor_msgs::PointCloud2& cloud)
+{
+    std::string preparedFile = CloudPreparation::preparedFileOf(filename);
+    if(!prepareClouds)
+    {
+        boost::system::error_code error;
+        boost::filesystem::remove(preparedFile, error);
+        return;
+    }
+
+    TRACE_SPAN("CloudRecorder::prepareCloud");
+    PointMatcher<float>::DataPoints dataPoints = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(cloud);
+    preparation.prepare(dataPoints);
+    if(!CloudPreparation::save(preparedFile, PointMatcher_ros::pointMatcherCloudToRosMsg<float>(
+               dataPoints, cloud.header.frame_id, ros::Time(0))))
+    {
+        ROS_WARN_STREAM("Could not save the prepared cloud of " << filename << ".");
+        boost::system::error_code error;
+        boost::filesystem::remove(preparedFile, error);
+    }
+}
+
+void CloudRecorder::syncFiles(const std::vector<std::string>& files) const
+{
+    if(files.empty()) return;
+    TRACE_SPAN("CloudRecorder::syncFiles");
+
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        syncFile(files[i], O_RDONLY);
+    }
+
+    // Make the new directory entries durable too.
+    syncFile(workingDirectory.empty() ? "." : workingDirectory, O_RDONLY | O_DIRECTORY);
+}
+
+// The anchor points below the highest one received that never came in.
+unsigned int CloudRecorder::missingClouds() const
+{
+    if(receivedIndices.empty()) return 0;
+    return *receivedIndices.rbegin() + 1 - receivedIndices.size();
+}
+
+husky_trainer::RecorderStatus CloudRecorder::status()
+{
+    husky_trainer::RecorderStatus status;
+    status.header.stamp = ros::Time::now();
+    status.received = receivedClouds;
+    status.missing = missingClouds();
+    status.queue_capacity = writers ? writers->capacity() : 0;
+    status.queue_depth = writers ? writers->pendingCount() : 0;
+    status.pending_transform = pendingClouds.size();
+    status.queue_latency = queueLatency.summary();
+    status.write_latency = writeLatency.summary();
+    status.backpressure = backpressure;
+
+    uint64_t bytes;
+    {
+        boost::mutex::scoped_lock lock(statsMutex);
+        status.written = writtenClouds;
+        status.failed = failedClouds;
+        bytes = writtenBytes;
+    }
+
+    // Throughput since the last periodic status. The window is left as it is,
+    // the statuses sent on a backpressure change do not cut it short.
+    double elapsed = (ros::WallTime::now() - lastStatusTime).toSec();
+    if(elapsed > 0.0)
+    {
+        status.clouds_per_second = (status.written - lastWrittenClouds) / elapsed;
+        status.megabytes_per_second = (bytes - lastWrittenBytes) / elapsed / 1e6;
+    }
+
+    return status;
+}
+
+void CloudRecorder::startStatusWindow()
+{
+    lastStatusTime = ros::WallTime::now();
+    boost::mutex::scoped_lock lock(statsMutex);
+    lastWrittenClouds = writtenClouds;
+    lastWrittenBytes = writtenBytes;
+}
+
+void CloudRecorder::statusCallback(const ros::TimerEvent& event)
+{
+    statusTopic.publish(status());
+    startStatusWindow();
+}
+
+bool CloudRecorder::saveAsPCD(std::string name, const sensor_msgs::PointCloud2 &cloud)
+{
+    return cloud_io::writePcd(name, cloud, false);
+}
+
+bool CloudRecorder::saveAsVTK(std::string name, const sensor_msgs::PointCloud2 &cloud)
+{
+    pcl::PCLPointCloud2 pclCloud;
+    pcl_conversions::toPCL(cloud, pclCloud);
+    return pcl::io::saveVTKFile(name, pclCloud) == 0;
+}
+
+sensor_msgs::PointCloud2 CloudRecorder::transformToFrame(const sensor_msgs::PointCloud2& cloud,
+                                                         const tf::StampedTransform& transform) const
+{
     sensor_msgs::PointCloud2 newCloud;
     pcl_ros::transformPointCloud(targetFrame, transform, cloud, newCloud);
     return newCloud;
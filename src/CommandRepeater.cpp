@@ -1,10 +1,13 @@
 
+#include <cstdlib>
+
 #include <ros/ros.h>
 #include <geometry_msgs/Twist.h>
 #include "husky_trainer/CommandRepeater.h"
 
 CommandRepeater::CommandRepeater(ros::NodeHandle n) :
-    desiredCommand()
+    desiredCommand(), commandExpired(true), forwardedCommands(0), timeouts(0), latencyProbes(false),
+    lastProbeSeq(0)
 {
     std::string desiredCommandTopicName, outputTopicName;
     double timeoutDouble;
@@ -12,14 +15,25 @@ CommandRepeater::CommandRepeater(ros::NodeHandle n) :
     n.param<std::string>(INPUT_TOPIC_PARAM, desiredCommandTopicName, DEFAULT_INPUT_TOPIC);
     n.param<std::string>(OUTPUT_TOPIC_PARAM, outputTopicName, DEFAULT_OUTPUT_TOPIC);
     n.param<double>(TIMEOUT_PARAM, timeoutDouble, DEFAULT_TIMEOUT);
+    n.param<bool>(FORWARD_IMMEDIATELY_PARAM, forwardImmediately, false);
+    n.param<bool>(LATENCY_PROBES_PARAM, latencyProbes, false);
 
     timeout = ros::Duration(timeoutDouble);
 
     publishTimer = n.createTimer(ros::Duration(1.0/COMMAND_RATE), &CommandRepeater::publishTimerCallback, this);
+    timeoutTimer = n.createTimer(timeout, &CommandRepeater::timeoutCallback, this, true, false);
     desiredCommandTopic = n.subscribe(desiredCommandTopicName, 10000, &CommandRepeater::updateDesiredCommand, this);
     outputCommandTopic = n.advertise<geometry_msgs::Twist>(outputTopicName, 100);
+    statsTopic = n.advertise<husky_trainer::CommandRepeaterStats>(STATS_TOPIC, 10);
+    statsTimer = n.createTimer(ros::Duration(STATS_PERIOD), &CommandRepeater::statsCallback, this);
+    if(latencyProbes)
+    {
+        probeTopic = n.subscribe(PROBE_TOPIC, 100, &CommandRepeater::probeCallback, this);
+        probeEchoTopic = n.advertise<husky_trainer::LatencyProbeEcho>(PROBE_ECHO_TOPIC, 100);
+    }
 
     lastCommandReceiveTime = ros::Time(0);
+    lastPublishTime = ros::Time(0);
 }
 
 void CommandRepeater::spin()
@@ -44,19 +58,135 @@ void CommandRepeater::updateDesiredCommand(const geometry_msgs::Twist::ConstPtr&
 {
     lastCommandReceiveTime = ros::Time::now();
     desiredCommand = *msg;
+    commandExpired = false;
+
+    if(latencyProbes)
+    {
+        ReceivedCommand received;
+        received.received = lastCommandReceiveTime;
+        receivedCommands.push_back(received);
+        if(receivedCommands.size() > RECEIVED_HISTORY) receivedCommands.pop_front();
+    }
+
+    // Restart the deadline.
+    timeoutTimer.stop();
+    timeoutTimer.start();
+
+    if(forwardImmediately)
+    {
+        publishCommand(desiredCommand);
+    }
 }
 
 void CommandRepeater::publishTimerCallback(const ros::TimerEvent& msg)
 {
+    if(msg.last_real != ros::Time(0))
+    {
+        ros::Duration period = msg.current_real - msg.last_real;
+        timerJitter.record(std::abs((period - ros::Duration(1.0/COMMAND_RATE)).toNSec()) / 1000);
+    }
+
+    // A command forwarded less than a period ago is recent enough.
+    if(forwardImmediately && msg.current_real - lastPublishTime < ros::Duration(1.0/COMMAND_RATE))
+    {
+        return;
+    }
+
     publishCommand(desiredCommand);
 }
 
+void CommandRepeater::timeoutCallback(const ros::TimerEvent&)
+{
+    commandExpired = true;
+    timeouts++;
+}
+
+void CommandRepeater::statsCallback(const ros::TimerEvent& event)
+{
+    husky_trainer::CommandRepeaterStats stats;
+    stats.header.stamp = event.current_real;
+    stats.window = STATS_PERIOD;
+    stats.forwarded = forwardedCommands;
+    stats.timeouts = timeouts;
+    stats.command_age = commandAge.summary();
+    stats.timer_jitter = timerJitter.summary();
+    statsTopic.publish(stats);
+
+    forwardedCommands = 0;
+    timeouts = 0;
+    commandAge.reset();
+    timerJitter.reset();
+}
+
 void CommandRepeater::publishCommand(const geometry_msgs::Twist command)
 {
     //Don't emit if the desired speed is older than the timeout.
-    if(ros::Time::now() - lastCommandReceiveTime < timeout && !isIdleTwistCommand(command))
+    if(!commandExpired && !isIdleTwistCommand(command))
     {
         outputCommandTopic.publish(command);
+        lastPublishTime = ros::Time::now();
+
+        // How stale the command reaching the robot is.
+        commandAge.record((lastPublishTime - lastCommandReceiveTime).toNSec() / 1000);
+        forwardedCommands++;
+
+        if(latencyProbes && !receivedCommands.empty() && receivedCommands.back().forwarded.isZero())
+        {
+            receivedCommands.back().forwarded = lastPublishTime;
+            echoProbes();
+        }
+    }
+}
+
+void CommandRepeater::probeCallback(const husky_trainer::LatencyProbe::ConstPtr& msg)
+{
+    // The repeat started over, its old probes are of no use. Its old commands
+    // were received before any new probe was published, they never match.
+    if(msg->seq < lastProbeSeq) pendingProbes.clear();
+    lastProbeSeq = msg->seq;
+
+    pendingProbes.push_back(*msg);
+    echoProbes();
+}
+
+// The command of a probe is the first one received after command_published.
+// It has its answer once it went out, or once a later command replaced it
+// without it going out.
+void CommandRepeater::echoProbes()
+{
+    ros::Time now = ros::Time::now();
+    std::deque<husky_trainer::LatencyProbe>::iterator probe = pendingProbes.begin();
+    while(probe != pendingProbes.end())
+    {
+        std::deque<ReceivedCommand>::const_iterator command = receivedCommands.begin();
+        while(command != receivedCommands.end() && command->received < probe->command_published) ++command;
+
+        bool done = false;
+        if(command != receivedCommands.end())
+        {
+            if(!command->forwarded.isZero())
+            {
+                husky_trainer::LatencyProbeEcho echo;
+                echo.seq = probe->seq;
+                echo.command_received = command->received;
+                echo.command_forwarded = command->forwarded;
+                probeEchoTopic.publish(echo);
+                done = true;
+            }
+            else
+            {
+                done = command + 1 != receivedCommands.end();
+            }
+        }
+
+        if(done || now - probe->command_published > ros::Duration(PROBE_WINDOW))
+        {
+            probe = pendingProbes.erase(probe);
+        }
+        else
+        {
+            ++probe;
+        }
     }
 }
 
@@ -2,10 +2,9 @@
 #include "husky_trainer/Controller.h"
 
 const double Controller::SAMPLING_PERIOD = 0.33;
-const std::string Controller::CORRECTED_ERROR_TOPIC = 
-    "/teach_repeat/corrected_error";
 
-Controller::Controller(ros::NodeHandle n) 
+// The gains and limits are the defaults of Repeat.cfg until updateParams.
+Controller::Controller()
 {
     husky_trainer::TrajectoryError error;
     error.x = 0.0;
@@ -13,8 +12,8 @@ Controller::Controller(ros::NodeHandle n)
     error.theta = 0.0;
     currentError = error;
 
-    correctedErrorTopic = 
-        n.advertise<husky_trainer::TrajectoryError>(CORRECTED_ERROR_TOPIC, 100);
+    husky_trainer::RepeatConfig defaults = husky_trainer::RepeatConfig::__getDefault__();
+    updateParams(defaults);
 }
         
 geometry_msgs::Twist Controller::correctCommand(geometry_msgs::Twist command)
@@ -22,14 +21,15 @@ geometry_msgs::Twist Controller::correctCommand(geometry_msgs::Twist command)
     return cutoff(proportionalGain(command));
 }
 
-void Controller::updateError(husky_trainer::TrajectoryError newError)
+// Returns the filtered error the commands are now corrected with.
+husky_trainer::TrajectoryError Controller::updateError(husky_trainer::TrajectoryError newError)
 {
     double filteredX = iir(currentError.x, newError.x);
     currentError.x = filteredX;
     currentError.y = newError.y;
     currentError.theta = newError.theta;
 
-    correctedErrorTopic.publish(currentError);
+    return currentError;
 }
 
 geometry_msgs::Twist Controller::cutoff(geometry_msgs::Twist command)
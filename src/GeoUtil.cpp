@@ -48,6 +48,17 @@ PM::TransformationParameters pmTransFromPoseToPose(geometry_msgs::Pose from, geo
     return  T.matrix().cast<float>();
 }
 
+// The transformation that takes points from the frame of the pose to the frame
+// the pose is expressed in.
+PM::TransformationParameters pmTransOfPose(const geometry_msgs::Pose& pose)
+{
+    Eigen::Affine3f T =
+        Eigen::Translation3f(pose.position.x, pose.position.y, pose.position.z) *
+        rosQuatToEigenQuat(pose.orientation).normalized();
+
+    return T.matrix();
+}
+
 Eigen::Quaternionf transFromQuatToQuat(Eigen::Quaternionf from, Eigen::Quaternionf to)
 {
     from.normalize();
@@ -0,0 +1,137 @@
+
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+
+#include "husky_trainer/LatencyHistogram.h"
+
+#define EXACT_BUCKETS 32
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define HIGHEST_BIT 39  // About 6 days.
+
+namespace
+{
+
+int highestBit(uint64_t value)
+{
+    int bit = 0;
+    while(value >>= 1) bit++;
+    return bit;
+}
+
+double millisecondsOf(uint64_t microseconds)
+{
+    return microseconds / 1000.0;
+}
+
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(uint64_t microseconds)
+{
+    mCounts[bucketOf(microseconds)].fetch_add(1, boost::memory_order_relaxed);
+    mSum.fetch_add(microseconds, boost::memory_order_relaxed);
+    mCount.fetch_add(1, boost::memory_order_relaxed);
+
+    uint64_t max = mMax.load(boost::memory_order_relaxed);
+    while(microseconds > max &&
+          !mMax.compare_exchange_weak(max, microseconds, boost::memory_order_relaxed))
+    { }
+}
+
+// Not atomic as a whole, a latency recorded meanwhile may be half counted.
+void LatencyHistogram::reset()
+{
+    for(size_t i = 0; i < BUCKET_COUNT; i++) mCounts[i].store(0);
+    mCount.store(0);
+    mSum.store(0);
+    mMax.store(0);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return mCount.load();
+}
+
+uint64_t LatencyHistogram::max() const
+{
+    return mMax.load();
+}
+
+double LatencyHistogram::mean() const
+{
+    uint64_t count = mCount.load();
+    return count > 0 ? static_cast<double>(mSum.load()) / count : 0.0;
+}
+
+// The highest value of the bucket holding the percentile, so the result errs
+// on the slow side, but never beyond the maximum.
+uint64_t LatencyHistogram::percentile(double percent) const
+{
+    uint64_t counts[BUCKET_COUNT];
+    uint64_t total = 0;
+    for(size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        counts[i] = mCounts[i].load(boost::memory_order_relaxed);
+        total += counts[i];
+    }
+    if(total == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(ceil(std::min(std::max(percent, 0.0), 100.0) / 100.0 * total));
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += counts[i];
+        if(seen >= rank) return std::min(highestValueOf(i), max());
+    }
+    return max();
+}
+
+husky_trainer::LatencySummary LatencyHistogram::summary() const
+{
+    husky_trainer::LatencySummary summary;
+    summary.count = count();
+    summary.mean_ms = mean() / 1000.0;
+    summary.p50_ms = millisecondsOf(percentile(50.0));
+    summary.p90_ms = millisecondsOf(percentile(90.0));
+    summary.p99_ms = millisecondsOf(percentile(99.0));
+    summary.max_ms = millisecondsOf(max());
+    return summary;
+}
+
+// For the stages timed with a histogram, unaffected by changes of the clock.
+uint64_t LatencyHistogram::monotonicMicroseconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t microseconds)
+{
+    if(microseconds < EXACT_BUCKETS) return microseconds;
+
+    int bit = std::min(highestBit(microseconds), HIGHEST_BIT);
+    if(bit == HIGHEST_BIT) microseconds = std::min<uint64_t>(microseconds, (1ULL << (HIGHEST_BIT + 1)) - 1);
+
+    int shift = bit - SUB_BUCKET_BITS;
+    return EXACT_BUCKETS + (bit - SUB_BUCKET_BITS - 1) * SUB_BUCKETS +
+        ((microseconds >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::highestValueOf(size_t bucket)
+{
+    if(bucket < EXACT_BUCKETS) return bucket;
+
+    size_t k = bucket - EXACT_BUCKETS;
+    int shift = k / SUB_BUCKETS + 1;
+    uint64_t subBucket = SUB_BUCKETS + k % SUB_BUCKETS;
+    return ((subBucket + 1) << shift) - 1;
+}
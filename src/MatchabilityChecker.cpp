@@ -0,0 +1,194 @@
+
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <ros/ros.h>
+
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/MatchabilityChecker.h"
+#include "husky_trainer/PointMatching.h"
+
+#define LOWEST_PRIORITY 19
+
+MatchabilityChecker::MatchabilityChecker(const PM::TransformationParameters& lidarToRobot,
+                                         const std::string& icpConfig, double inlierDistance,
+                                         size_t capacity) :
+    mLidarToRobot(lidarToRobot), mInlierDistance(inlierDistance), mCapacity(capacity),
+    mIcpConfig(icpConfig), mStopping(false), mChecking(false), mDropped(0)
+{
+    mThread = boost::thread(&MatchabilityChecker::work, this);
+}
+
+MatchabilityChecker::~MatchabilityChecker()
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mStopping = true;
+    }
+    mCheckAvailable.notify_all();
+    mThread.join();
+}
+
+bool MatchabilityChecker::submit(const Scan& reference, const Scan& reading)
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        if(mChecks.size() >= mCapacity)
+        {
+            mDropped++;
+            return false;
+        }
+
+        Check check;
+        check.reference = reference;
+        check.reading = reading;
+        mChecks.push_back(check);
+    }
+    mCheckAvailable.notify_one();
+    return true;
+}
+
+bool MatchabilityChecker::takeResult(Result& out)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    if(mResults.empty()) return false;
+
+    out = mResults.front();
+    mResults.pop_front();
+    return true;
+}
+
+// Waits for the queued checks to be done, their results can then be taken.
+void MatchabilityChecker::waitUntilIdle()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    while(!mChecks.empty() || mChecking)
+    {
+        mIdle.wait(lock);
+    }
+}
+
+unsigned int MatchabilityChecker::droppedCount() const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mDropped;
+}
+
+// The checks are only worth the time the rest of the teach leaves.
+void MatchabilityChecker::lowerPriority() const
+{
+#ifdef __linux__
+    if(setpriority(PRIO_PROCESS, syscall(SYS_gettid), LOWEST_PRIORITY) != 0)
+    {
+        ROS_WARN("Could not lower the priority of the matchability checks.");
+    }
+#endif
+}
+
+void MatchabilityChecker::work()
+{
+    lowerPriority();
+
+    PM::ICP icp;
+    std::ifstream config(mIcpConfig.c_str());
+    if(config.good())
+    {
+        icp.loadFromYaml(config);
+    }
+    else
+    {
+        if(!mIcpConfig.empty())
+        {
+            ROS_WARN_STREAM("Could not open " << mIcpConfig << ", checking matchability with the default ICP.");
+        }
+        icp.setDefault();
+    }
+
+    while(true)
+    {
+        Check job;
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            while(mChecks.empty() && !mStopping)
+            {
+                mCheckAvailable.wait(lock);
+            }
+
+            if(mStopping) return;
+
+            job = mChecks.front();
+            mChecks.pop_front();
+            mChecking = true;
+        }
+
+        Result result = check(job, icp);
+
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            mResults.push_back(result);
+            mChecking = false;
+        }
+        mIdle.notify_all();
+    }
+}
+
+// Both scans are brought in the robot frame and the reading is aligned on the
+// reference, starting from the displacement given by the odometry.
+MatchabilityChecker::Result MatchabilityChecker::check(const Check& job, PM::ICP& icp) const
+{
+    Result result;
+    result.reference = job.reference;
+    result.reading = job.reading;
+    result.overlap = 0.0;
+    result.residual = std::numeric_limits<double>::infinity();
+
+    PM::DataPoints reference = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(*job.reference.cloud);
+    PM::DataPoints reading = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(*job.reading.cloud);
+    pointmatching_tools::applyTransform(reference, mLidarToRobot);
+    pointmatching_tools::applyTransform(reading, mLidarToRobot);
+
+    if(reference.features.cols() == 0 || reading.features.cols() == 0) return result;
+
+    PM::TransformationParameters initialGuess =
+        geo_util::pmTransOfPose(job.reference.pose).inverse() * geo_util::pmTransOfPose(job.reading.pose);
+
+    PM::TransformationParameters readingToReference;
+    try {
+        readingToReference = icp(reading, reference, initialGuess);
+    } catch(PM::ConvergenceError& e) {
+        return result;
+    }
+    icp.transformations.apply(reading, readingToReference);
+
+    PM::Parameters matcherParams;
+    matcherParams["knn"] = "1";
+    PM::Matcher* matcher = PM::get().REG(Matcher).create("KDTreeMatcher", matcherParams);
+    matcher->init(reference);
+    PM::Matches matches = matcher->findClosests(reading);
+    delete matcher;
+
+    // The matcher gives squared distances.
+    const float maxDistance = mInlierDistance * mInlierDistance;
+    size_t inliers = 0;
+    double squaredDistances = 0.0;
+    for(int i = 0; i < matches.dists.cols(); i++)
+    {
+        if(matches.dists(0, i) <= maxDistance)
+        {
+            inliers++;
+            squaredDistances += matches.dists(0, i);
+        }
+    }
+
+    result.overlap = static_cast<double>(inliers) / reading.features.cols();
+    if(inliers > 0) result.residual = sqrt(squaredDistances / inliers);
+
+    return result;
+}
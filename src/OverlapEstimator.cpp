@@ -0,0 +1,178 @@
+
+#include <cmath>
+
+#include "husky_trainer/CloudCompression.h"
+#include "husky_trainer/OverlapEstimator.h"
+
+#define VOXEL_KEY_BITS 21
+#define VOXEL_KEY_OFFSET (1 << (VOXEL_KEY_BITS - 1))
+#define VOXEL_KEY_MASK ((1 << VOXEL_KEY_BITS) - 1)
+
+namespace
+{
+
+uint64_t voxelKey(const Eigen::Vector3f& point, double voxelSize)
+{
+    uint64_t key = 0;
+    for(int i = 0; i < 3; i++)
+    {
+        int64_t cell = static_cast<int64_t>(floor(point[i] / voxelSize)) + VOXEL_KEY_OFFSET;
+        key = (key << VOXEL_KEY_BITS) | (static_cast<uint64_t>(cell) & VOXEL_KEY_MASK);
+    }
+    return key;
+}
+
+Eigen::Affine3f transformOfPose(const geometry_msgs::Pose& pose)
+{
+    return Eigen::Translation3f(pose.position.x, pose.position.y, pose.position.z) *
+        Eigen::Quaternionf(pose.orientation.w, pose.orientation.x,
+                           pose.orientation.y, pose.orientation.z).normalized();
+}
+
+}
+
+OverlapEstimator::OverlapEstimator(const Eigen::Matrix4f& lidarToRobot, double voxelSize, double maxRange) :
+    mLidarToRobot(lidarToRobot), mVoxelSize(voxelSize), mMaxRange(maxRange),
+    mHasPending(false), mHasResult(false), mHasNewReference(false), mHasReference(false),
+    mStopping(false)
+{
+    mThread = boost::thread(&OverlapEstimator::work, this);
+}
+
+OverlapEstimator::~OverlapEstimator()
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+    mThread.join();
+}
+
+void OverlapEstimator::submit(const sensor_msgs::PointCloud2ConstPtr& scan, const geometry_msgs::Pose& pose)
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mPending.scan = scan;
+        mPending.pose = pose;
+        mHasPending = true;
+    }
+    mWorkAvailable.notify_one();
+}
+
+// The latest evaluated scan, if there is one that was not taken yet.
+bool OverlapEstimator::takeResult(Result& out)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    if(!mHasResult) return false;
+
+    out = mResult;
+    mResult.scan.reset();
+    mHasResult = false;
+    return true;
+}
+
+// Scans submitted before the new reference are evaluated against it.
+void OverlapEstimator::setReference(const sensor_msgs::PointCloud2ConstPtr& scan,
+                                    const geometry_msgs::Pose& pose)
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mNewReference.scan = scan;
+        mNewReference.pose = pose;
+        mHasNewReference = true;
+        mHasReference = true;
+        mHasResult = false;
+    }
+    mWorkAvailable.notify_one();
+}
+
+bool OverlapEstimator::hasReference() const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mHasReference;
+}
+
+void OverlapEstimator::work()
+{
+    while(true)
+    {
+        Result job;
+        bool isReference;
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            while(!mHasPending && !mHasNewReference && !mStopping)
+            {
+                mWorkAvailable.wait(lock);
+            }
+
+            if(mStopping) return;
+
+            isReference = mHasNewReference;
+            if(isReference)
+            {
+                job = mNewReference;
+                mNewReference.scan.reset();
+                mHasNewReference = false;
+            }
+            else
+            {
+                job = mPending;
+                mPending.scan.reset();
+                mHasPending = false;
+            }
+        }
+
+        if(isReference)
+        {
+            mReferenceVoxels.clear();
+            voxelize(*job.scan, job.pose, mReferenceVoxels);
+            continue;
+        }
+
+        if(mReferenceVoxels.empty()) continue;
+
+        VoxelSet voxels;
+        voxelize(*job.scan, job.pose, voxels);
+        job.overlap = overlapWithReference(voxels);
+
+        boost::mutex::scoped_lock lock(mMutex);
+        // A reference that came in while we were busy makes the result stale.
+        if(!mHasNewReference)
+        {
+            mResult = job;
+            mHasResult = true;
+        }
+    }
+}
+
+void OverlapEstimator::voxelize(const sensor_msgs::PointCloud2& scan, const geometry_msgs::Pose& pose,
+                                VoxelSet& out) const
+{
+    std::vector<float> xyz;
+    if(!cloud_compression::extractPoints(scan, xyz)) return;
+
+    Eigen::Affine3f lidarToOdom = transformOfPose(pose) * mLidarToRobot;
+    float maxRangeSquared = mMaxRange * mMaxRange;
+
+    for(size_t i = 0; i + 2 < xyz.size(); i += 3)
+    {
+        Eigen::Vector3f point(xyz[i], xyz[i + 1], xyz[i + 2]);
+        if(point.squaredNorm() > maxRangeSquared) continue;
+
+        out.insert(voxelKey(lidarToOdom * point, mVoxelSize));
+    }
+}
+
+double OverlapEstimator::overlapWithReference(const VoxelSet& voxels) const
+{
+    if(voxels.empty()) return 0.0;
+
+    size_t shared = 0;
+    for(VoxelSet::const_iterator it = voxels.begin(); it != voxels.end(); ++it)
+    {
+        if(mReferenceVoxels.count(*it) > 0) shared++;
+    }
+
+    return static_cast<double>(shared) / voxels.size();
+}
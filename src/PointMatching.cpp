@@ -55,5 +55,14 @@ void applyTransform(DP& cloud, PM::TransformationParameters transform)
     icp.transformations.apply(cloud, transform);
 }
 
+// Bring a raw scan in the robot frame and save it as an anchor point cloud.
+void saveTransformedCloud(const sensor_msgs::PointCloud2ConstPtr& cloud,
+                          PM::TransformationParameters transform,
+                          const std::string& filename)
+{
+    DP dataPoints = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(*cloud);
+    applyTransform(dataPoints, transform);
+    dataPoints.save(filename);
 }
 
+}
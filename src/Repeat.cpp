@@ -11,105 +11,170 @@
 
 #include "husky_trainer/Repeat.h"
 #include "husky_trainer/ControllerMappings.h"
+#include "husky_trainer/RosRepeatIO.h"
+#include "husky_trainer/Trace.h"
 
 // Parameter names.
 const std::string Repeat::SOURCE_TOPIC_PARAM = "readings_topic";
 const std::string Repeat::COMMAND_OUTPUT_PARAM = "command_output_topic";
 const std::string Repeat::WORKING_DIRECTORY_PARAM = "working_directory";
+const std::string Repeat::ROUTE_LIBRARY_PARAM = "route_library";
+const std::string Repeat::ROUTE_PARAM = "route";
+const std::string Repeat::START_ANCHOR_PARAM = "start_anchor";
+const std::string Repeat::GOAL_ROUTE_PARAM = "goal_route";
+const std::string Repeat::GOAL_ANCHOR_PARAM = "goal_anchor";
+const std::string Repeat::LATENCY_PROBES_PARAM = "latency_probes";
 
 // Default values.
 const std::string Repeat::DEFAULT_SOURCE_TOPIC = "/cloud";
-const std::string Repeat::DEFAULT_COMMAND_OUTPUT_TOPIC =
-        "/teach_repeat/desired_command";
 
 const double Repeat::LOOP_RATE = 100.0;
 const std::string Repeat::JOY_TOPIC = "/joy_teleop/joy";
-const std::string Repeat::REFERENCE_POSE_TOPIC = "/teach_repeat/reference_pose";
-const std::string Repeat::ERROR_REPORTING_TOPIC = "/teach_repeat/raw_error";
-const std::string Repeat::AP_SWITCH_TOPIC = "/teach_repeat/ap_switch";
-const std::string Repeat::CLOUD_MATCHING_SERVICE = "/match_clouds";
+const double Repeat::STATS_PERIOD = 1.0;
+const std::string Repeat::TRACE_FILE = "repeat_trace.json";
 const std::string Repeat::LIDAR_FRAME = "/velodyne";
 const std::string Repeat::ROBOT_FRAME = "/base_link";
 const std::string Repeat::WORLD_FRAME = "/odom";
 
 Repeat::Repeat(ros::NodeHandle n) :
-    loopRate(LOOP_RATE), controller(n)
+    rosClock(new RosRepeatClock()), rosIO(new RosRepeatIO(n)), clock(rosClock.get()), io(rosIO.get()),
+    synchronousMatching(false), loopRate(LOOP_RATE), matchingPool(new WorkerPool(1, 1)), probePending(false),
+    probeSeq(0), receivedClouds(0), droppedClouds(0), failedMatches(0)
 {
-    std::string workingDirectory;
-
     // Read parameters.
     n.param<std::string>(SOURCE_TOPIC_PARAM, sourceTopicName, DEFAULT_SOURCE_TOPIC);
-    n.param<std::string>(WORKING_DIRECTORY_PARAM, workingDirectory, "");
+    n.param<bool>(LATENCY_PROBES_PARAM, latencyProbes, false);
 
-    if(!chdir(workingDirectory.c_str()) != 0)
-    {
-        ROS_WARN("Failed to switch to the demanded directory.");
-    }
+    // Setup the dynamic reconfiguration server.
+    drServer.reset(new dynamic_reconfigure::Server<husky_trainer::RepeatConfig>(n));
+    dynamic_reconfigure::Server<husky_trainer::RepeatConfig>::CallbackType callback;
+    callback = boost::bind(&Repeat::paramCallback, this, _1, _2);
+    drServer->setCallback(callback);
+}
+
+Repeat::Repeat(const std::string& routeDirectory, const tf::Transform& lidarToRobot,
+               husky_trainer::RepeatConfig config, RepeatClock& clock, RepeatIO& io) :
+    clock(&clock), io(&io), synchronousMatching(true), loopRate(LOOP_RATE), latencyProbes(false),
+    probePending(false), probeSeq(0), receivedClouds(0), droppedClouds(0), failedMatches(0)
+{
+    loadRoute(routeDirectory);
+    startAtBeginning();
 
+    tFromLidarToRobot.setData(lidarToRobot);
+    paramCallback(config, 0);
+}
+
+// Reads the teach and waits for the transform from the lidar to the robot,
+// which may take seconds, then subscribes to the clouds and the joystick.
+// Returns false if the transform never came.
+bool Repeat::load(ros::NodeHandle n)
+{
     // Read from the teach files.
-    loadCommands("speeds.sl", commands);
-    loadPositions("positions.pl", positions);
-    loadAnchorPoints("anchorPoints.apd", anchorPoints);
+    if(!loadPlannedRoute(n))
+    {
+        loadRoute(routeDirectoryOfParams(n));
+    }
     ROS_INFO_STREAM("Done loading the teach in memory.");
 
-    currentStatus = PAUSE;
-    commandCursor = commands.begin();
-    positionCursor = positions.begin();
-    anchorPointCursor = anchorPoints.begin();
+    startAtBeginning();
+
+    // Fetch the transform from lidar to base_link and cache it.
+    tf::TransformListener tfListener;
+    try
+    {
+        tfListener.waitForTransform(ROBOT_FRAME, LIDAR_FRAME, ros::Time(0), ros::Duration(5.0));
+        tfListener.lookupTransform(ROBOT_FRAME, LIDAR_FRAME, ros::Time(0), tFromLidarToRobot);
+    }
+    catch(tf::TransformException& e)
+    {
+        ROS_ERROR_STREAM("Could not get the transform from " << LIDAR_FRAME << " to " << ROBOT_FRAME << ": "
+                         << e.what());
+        return false;
+    }
 
     // Make the appropriate subscriptions.
     readingTopic = n.subscribe(sourceTopicName, 10, &Repeat::cloudCallback, this);
     joystickTopic = n.subscribe(JOY_TOPIC, 1000, &Repeat::joystickCallback, this);
-    errorReportingTopic = n.advertise<husky_trainer::TrajectoryError>(ERROR_REPORTING_TOPIC, 1000);
-    commandRepeaterTopic = n.advertise<geometry_msgs::Twist>(DEFAULT_COMMAND_OUTPUT_TOPIC, 1000);
-    referencePoseTopic = n.advertise<geometry_msgs::Pose>(REFERENCE_POSE_TOPIC, 100);
-    anchorPointSwitchTopic = n.advertise<husky_trainer::AnchorPointSwitch>(AP_SWITCH_TOPIC, 1000);
+    statsTimer = n.createTimer(ros::Duration(STATS_PERIOD), &Repeat::statsCallback, this);
 
-    icpService = n.serviceClient<pointmatcher_ros::MatchClouds>(CLOUD_MATCHING_SERVICE, false);
+    return true;
+}
 
-    // Fetch the transform from lidar to base_link and cache it.
-    tf::TransformListener tfListener;
-    tfListener.waitForTransform(ROBOT_FRAME, LIDAR_FRAME, ros::Time(0), ros::Duration(5.0));
-    tfListener.lookupTransform(ROBOT_FRAME, LIDAR_FRAME, ros::Time(0), tFromLidarToRobot);
+void Repeat::loadRoute(const std::string& routeDirectory)
+{
+    this->routeDirectory = routeDirectory;
+    loadCommands(RouteLibrary::joinPath(routeDirectory, RouteLibrary::COMMANDS_FILE), commands);
+    loadPositions(RouteLibrary::joinPath(routeDirectory, RouteLibrary::POSITIONS_FILE), positions);
+    loadAnchorPoints(RouteLibrary::joinPath(routeDirectory, RouteLibrary::ANCHOR_POINTS_FILE), anchorPoints);
+}
 
-    // Setup the dynamic reconfiguration server.
-    dynamic_reconfigure::Server<husky_trainer::RepeatConfig>::CallbackType callback;
-    callback = boost::bind(&Repeat::paramCallback, this, _1, _2);
-    drServer.setCallback(callback);
+void Repeat::startAtBeginning()
+{
+    currentStatus = PAUSE;
+    commandCursor = commands.begin();
+    positionCursor = positions.begin();
+    anchorPointCursor = anchorPoints.begin();
 }
 
 void Repeat::spin()
 {
     while(ros::ok())
     {
-        ros::Time timeOfSpin = simTime();
-        updateAnchorPoint();
-
-        //Update the command we are playing.
-        if(currentStatus == FORWARD || currentStatus == REWIND)
-        {
-            geometry_msgs::Twist nextCommand =
-                controller.correctCommand(commandOfTime(timeOfSpin));
-            commandRepeaterTopic.publish(nextCommand);
-        }
-
-        referencePoseTopic.publish(poseOfTime(simTime()));
+        tick();
 
         ros::spinOnce();
         loopRate.sleep();
     }
 }
 
+// Drives the playback from a timer instead of spin(), for use in a nodelet.
+void Repeat::startPlaybackTimer(ros::NodeHandle n)
+{
+    playbackTimer = n.createTimer(ros::Duration(1.0 / LOOP_RATE), &Repeat::playbackTimerCallback, this);
+}
+
+void Repeat::playbackTimerCallback(const ros::TimerEvent&)
+{
+    tick();
+}
+
+void Repeat::tick()
+{
+    TRACE_SPAN("Repeat::tick");
+    ros::Time timeOfSpin = simTime();
+    updateAnchorPoint();
+
+    //Update the command we are playing.
+    if(currentStatus == FORWARD || currentStatus == REWIND)
+    {
+        geometry_msgs::Twist nextCommand =
+            controller.correctCommand(commandOfTime(timeOfSpin));
+        husky_trainer::LatencyProbe probe;
+        bool probed = latencyProbes && takeLatencyProbe(nextCommand, probe);
+        io->publishCommand(nextCommand);
+        if(probed) io->publishLatencyProbe(probe);
+    }
+
+    io->publishReferencePose(poseOfTime(simTime()));
+}
+
 Repeat::~Repeat()
 {
+    playbackTimer.stop();
+    statsTimer.stop();
     readingTopic.shutdown();
-    serviceCallLock.lock();
-    serviceCallLock.unlock();
+    joystickTopic.shutdown();
+
+    // Waits for the match in progress.
+    matchingPool.reset();
+
+    TRACE_DUMP(RouteLibrary::joinPath(routeDirectory, TRACE_FILE));
 }
 
 
 void Repeat::updateAnchorPoint()
 {
+    TRACE_SPAN("Repeat::updateAnchorPoint");
     geometry_msgs::Pose currentPose = poseOfTime(simTime());
 
     double distanceToCurrentAnchorPoint =
@@ -147,14 +212,21 @@ void Repeat::updateAnchorPoint()
             );
 
         husky_trainer::AnchorPointSwitch msg;
-        msg.stamp = ros::Time::now();
+        msg.stamp = clock->now();
         msg.newAnchorPoint = anchorPointCursor->name();
-        anchorPointSwitchTopic.publish(msg);
+        io->publishAnchorPointSwitch(msg);
     }
 }
 
-void Repeat::updateError(const sensor_msgs::PointCloud2& reading)
+// Every stage is timed with the monotonic clock. The transform and the copy
+// of the clouds into the request are only timed for the clouds that get to
+// the matcher.
+void Repeat::updateError(const sensor_msgs::PointCloud2ConstPtr& reading, uint64_t receivedAt,
+                         ros::Time receivedTime)
 {
+    TRACE_SPAN("Repeat::updateError");
+    uint64_t stageStart = LatencyHistogram::monotonicMicroseconds();
+
     tf::Transform tFromReadingToAnchor =
             geo_util::transFromPoseToPose(poseOfTime(simTime()), anchorPointCursor->getPosition());
 
@@ -162,36 +234,128 @@ void Repeat::updateError(const sensor_msgs::PointCloud2& reading)
     pcl_ros::transformAsMatrix(tFromReadingToAnchor*tFromLidarToRobot, eigenTransform);
 
     sensor_msgs::PointCloud2 transformedReadingCloudMsg;
-    pcl_ros::transformPointCloud(eigenTransform, reading, transformedReadingCloudMsg);
+    pcl_ros::transformPointCloud(eigenTransform, *reading, transformedReadingCloudMsg);
+
+    uint64_t stageEnd = LatencyHistogram::monotonicMicroseconds();
+    transformLatency.record(stageEnd - stageStart);
+    stageStart = stageEnd;
 
     pointmatcher_ros::MatchClouds pmMessage;
     pmMessage.request.readings = transformedReadingCloudMsg;
     pmMessage.request.reference = anchorPointCursor->getCloud();
 
-    if(serviceCallLock.try_lock())
+    stageEnd = LatencyHistogram::monotonicMicroseconds();
+    copyLatency.record(stageEnd - stageStart);
+    stageStart = stageEnd;
+
+    bool matched;
+    {
+        TRACE_SPAN("Repeat::matchClouds");
+        matched = io->matchClouds(pmMessage, anchorPointCursor->isPrepared());
+    }
+
+    if(matched)
     {
-        if(icpService.call(pmMessage))
+        stageEnd = LatencyHistogram::monotonicMicroseconds();
+        matchingLatency.record(stageEnd - stageStart);
+        stageStart = stageEnd;
+        ros::Time matchedTime = clock->now();
+
+        husky_trainer::TrajectoryError rawError =
+            pointmatching_tools::controlErrorOfTransformation(
+                    pmMessage.response.transform
+                );
+
+        io->publishRawError(rawError);
+        io->publishCorrectedError(controller.updateError(rawError));
+
+        stageEnd = LatencyHistogram::monotonicMicroseconds();
+        controllerLatency.record(stageEnd - stageStart);
+        totalLatency.record(stageEnd - receivedAt);
+
+        if(latencyProbes)
         {
-            husky_trainer::TrajectoryError rawError =
-                pointmatching_tools::controlErrorOfTransformation(
-                        pmMessage.response.transform
-                    );
-
-            errorReportingTopic.publish(rawError);
-            controller.updateError(rawError);
-        } else {
-            ROS_WARN("There was a problem with the point matching service.");
-            switchToStatus(ERROR);
+            boost::mutex::scoped_lock lock(probeMutex);
+            pendingProbe.scan_stamp = reading->header.stamp;
+            pendingProbe.received = receivedTime;
+            pendingProbe.matched = matchedTime;
+            pendingProbe.corrected = clock->now();
+            probePending = true;
         }
-        serviceCallLock.unlock();
     } else {
-        ROS_DEBUG("ICP service was busy, dropped a cloud.");
+        failedMatches++;
+        ROS_WARN("There was a problem with the point matching service.");
+        switchToStatus(ERROR);
     }
 }
 
 void Repeat::cloudCallback(const sensor_msgs::PointCloud2ConstPtr msg)
 {
-    boost::thread thread(&Repeat::updateError, this, *msg);
+    TRACE_SPAN("Repeat::cloudCallback");
+    uint64_t receivedAt = LatencyHistogram::monotonicMicroseconds();
+    receivedClouds++;
+
+    // From the stamp of the scan, so in ROS time rather than monotonic.
+    ros::Time receivedTime = clock->now();
+    ros::Duration age = receivedTime - msg->header.stamp;
+    if(age > ros::Duration(0)) receiveLatency.record(age.toNSec() / 1000);
+
+    if(synchronousMatching)
+    {
+        updateError(msg, receivedAt, receivedTime);
+    }
+    // Only this callback posts, so an idle pool stays free for the cloud.
+    else if(matchingPool->pendingCount() > 0 ||
+            !matchingPool->tryPost(boost::bind(&Repeat::updateError, this, msg, receivedAt, receivedTime)))
+    {
+        droppedClouds++;
+        ROS_DEBUG("ICP service was busy, dropped a cloud.");
+    }
+}
+
+// The first command out after a correction carries its probe. The probe is
+// taken before the command goes out, so that the command is received after
+// command_published. A correction replaced before any command went out is
+// not reported.
+bool Repeat::takeLatencyProbe(const geometry_msgs::Twist& command, husky_trainer::LatencyProbe& probe)
+{
+    {
+        boost::mutex::scoped_lock lock(probeMutex);
+        if(!probePending) return false;
+        probe = pendingProbe;
+        probePending = false;
+    }
+
+    probe.seq = ++probeSeq;
+    probe.command_published = clock->now();
+    probe.command = command;
+    return true;
+}
+
+void Repeat::statsCallback(const ros::TimerEvent& event)
+{
+    husky_trainer::RepeatStats stats;
+    stats.header.stamp = event.current_real;
+    stats.window = STATS_PERIOD;
+    stats.received = receivedClouds.exchange(0);
+    stats.dropped = droppedClouds.exchange(0);
+    stats.failed = failedMatches.exchange(0);
+    stats.receive = receiveLatency.summary();
+    stats.copy = copyLatency.summary();
+    stats.transform = transformLatency.summary();
+    stats.matching = matchingLatency.summary();
+    stats.controller = controllerLatency.summary();
+    stats.total = totalLatency.summary();
+    stats.corrections = stats.total.count;
+    stats.correction_rate = stats.corrections / STATS_PERIOD;
+    io->publishStats(stats);
+
+    receiveLatency.reset();
+    copyLatency.reset();
+    transformLatency.reset();
+    matchingLatency.reset();
+    controllerLatency.reset();
+    totalLatency.reset();
 }
 
 void Repeat::joystickCallback(sensor_msgs::Joy::ConstPtr msg)
@@ -261,12 +425,12 @@ geometry_msgs::Pose Repeat::poseOfTime(ros::Time time)
 
 void Repeat::pausePlayback()
 {
-    commandRepeaterTopic.publish(CommandRepeater::idleTwistCommand());
+    io->publishCommand(CommandRepeater::idleTwistCommand());
 
     if(currentStatus == FORWARD) {
-        baseSimTime += ros::Time::now() - timePlaybackStarted;
+        baseSimTime += clock->now() - timePlaybackStarted;
     } else if (currentStatus == REWIND) {
-        ros::Duration delta = ros::Time::now() - timePlaybackStarted;
+        ros::Duration delta = clock->now() - timePlaybackStarted;
 
         baseSimTime = trySubtract(delta, baseSimTime);
     }
@@ -276,13 +440,13 @@ void Repeat::pausePlayback()
 
 void Repeat::startPlayback()
 {
-    timePlaybackStarted = ros::Time::now();
+    timePlaybackStarted = clock->now();
 }
 
 ros::Time Repeat::simTime()
 {
     ros::Time simTime;
-    ros::Duration delta = ros::Time::now() - timePlaybackStarted;
+    ros::Duration delta = clock->now() - timePlaybackStarted;
 
     if(currentStatus == FORWARD) {
         simTime = baseSimTime + delta;
@@ -346,6 +510,186 @@ void Repeat::switchToStatus(Status desiredStatus)
     }
 }
 
+// The teach files are read from the route named in the parameters if a route
+// library is given, from the working directory otherwise.
+std::string Repeat::routeDirectoryOfParams(ros::NodeHandle& n)
+{
+    std::string workingDirectory, libraryRoot, routeName;
+    n.param<std::string>(WORKING_DIRECTORY_PARAM, workingDirectory, "");
+    n.param<std::string>(ROUTE_LIBRARY_PARAM, libraryRoot, "");
+    n.param<std::string>(ROUTE_PARAM, routeName, "");
+
+    if(libraryRoot.empty() || routeName.empty())
+    {
+        return workingDirectory;
+    }
+
+    RouteLibrary library(libraryRoot);
+    RouteEntry entry;
+    if(library.loadIndex() && library.findRoute(routeName, entry))
+    {
+        ROS_INFO_STREAM("Opening route " << routeName << " with " <<
+                        entry.anchorCount << " anchor points.");
+    }
+    else
+    {
+        ROS_WARN_STREAM("Route " << routeName << " is not in the index of " << libraryRoot);
+    }
+
+    return library.routeDirectory(routeName);
+}
+
+// If a goal route is given, plan a path across the routes of the library with
+// the route graph, and play it back as a single teach.
+bool Repeat::loadPlannedRoute(ros::NodeHandle& n)
+{
+    std::string libraryRoot, startRoute, goalRoute;
+    int startAnchor, goalAnchor;
+    n.param<std::string>(ROUTE_LIBRARY_PARAM, libraryRoot, "");
+    n.param<std::string>(ROUTE_PARAM, startRoute, "");
+    n.param<std::string>(GOAL_ROUTE_PARAM, goalRoute, "");
+    n.param<int>(START_ANCHOR_PARAM, startAnchor, 0);
+    n.param<int>(GOAL_ANCHOR_PARAM, goalAnchor, -1);
+
+    if(libraryRoot.empty() || startRoute.empty() || goalRoute.empty())
+    {
+        return false;
+    }
+
+    RouteLibrary library(libraryRoot);
+    RouteGraph graph;
+    std::vector<RouteLeg> legs;
+
+    library.loadIndex();
+    graph.loadRoutes(library);
+
+    if(!graph.load(RouteLibrary::joinPath(libraryRoot, RouteGraph::GRAPH_FILE)) ||
+       !graph.plan(startRoute, startAnchor, goalRoute, goalAnchor, legs))
+    {
+        ROS_ERROR_STREAM("Could not plan a path from " << startRoute << " to " << goalRoute <<
+                         ". Playing back " << startRoute << " only.");
+        return false;
+    }
+
+    for(size_t i = 0; i < legs.size(); i++)
+    {
+        ROS_INFO_STREAM("Leg " << i << ": " << legs[i].route << " from anchor point " <<
+                        legs[i].firstAnchor << " to " << legs[i].lastAnchor << ".");
+    }
+
+    if(!composeLegs(library, legs))
+    {
+        ROS_ERROR_STREAM("Could not load the planned path. Playing back " << startRoute << " only.");
+        positions.clear();
+        commands.clear();
+        anchorPoints.clear();
+        return false;
+    }
+
+    routeDirectory = library.routeDirectory(startRoute);
+    return true;
+}
+
+// Concatenate the legs into one timeline. Every leg is cut out of its route
+// at the positions closest to its first and last anchor points, and shifted
+// in time so that it starts where the previous leg ended. Everything is loaded
+// up front, so switching routes at a junction is just moving the cursors.
+// Fails if any leg does not match its route, a partial path is no use.
+bool Repeat::composeLegs(const RouteLibrary& library, const std::vector<RouteLeg>& legs)
+{
+    double legStartTime = 0.0;
+
+    for(size_t i = 0; i < legs.size(); i++)
+    {
+        const RouteLeg& leg = legs[i];
+        std::string routeDirectory = library.routeDirectory(leg.route);
+
+        std::vector<geometry_msgs::PoseStamped> routePositions;
+        std::vector<geometry_msgs::TwistStamped> routeCommands;
+        std::vector<geometry_msgs::Pose> routeAnchorPoses;
+        std::vector<std::string> routeAnchorNames;
+
+        loadPositions(RouteLibrary::joinPath(routeDirectory, RouteLibrary::POSITIONS_FILE), routePositions);
+        loadCommands(RouteLibrary::joinPath(routeDirectory, RouteLibrary::COMMANDS_FILE), routeCommands);
+
+        std::ifstream anchorPointsFile(
+                RouteLibrary::joinPath(routeDirectory, RouteLibrary::ANCHOR_POINTS_FILE).c_str());
+        std::string lineBuffer;
+        while(std::getline(anchorPointsFile, lineBuffer))
+        {
+            if(lineBuffer.empty()) continue;
+            AnchorPoint entry(lineBuffer);
+            routeAnchorNames.push_back(entry.name());
+            routeAnchorPoses.push_back(entry.getPosition());
+        }
+
+        if(routePositions.empty() || leg.firstAnchor < 0 || leg.firstAnchor > leg.lastAnchor ||
+           leg.lastAnchor >= static_cast<int>(routeAnchorPoses.size()))
+        {
+            ROS_ERROR_STREAM("Route " << leg.route << " does not match the route graph.");
+            return false;
+        }
+
+        size_t firstPosition = i == 0 && leg.firstAnchor == 0 ? 0 :
+            closestPositionIndex(routePositions, routeAnchorPoses[leg.firstAnchor], 0);
+        size_t lastPosition = i == legs.size() - 1 && leg.lastAnchor == static_cast<int>(routeAnchorPoses.size()) - 1 ?
+            routePositions.size() - 1 :
+            closestPositionIndex(routePositions, routeAnchorPoses[leg.lastAnchor], firstPosition);
+
+        double firstTime = firstPosition == 0 ? 0.0 : routePositions[firstPosition].header.stamp.toSec();
+        double lastTime = routePositions[lastPosition].header.stamp.toSec();
+        double shift = legStartTime - firstTime;
+
+        for(size_t j = firstPosition; j <= lastPosition; j++)
+        {
+            positions.push_back(routePositions[j]);
+            positions.back().header.stamp = ros::Time(routePositions[j].header.stamp.toSec() + shift);
+        }
+
+        for(size_t j = 0; j < routeCommands.size(); j++)
+        {
+            double stamp = routeCommands[j].header.stamp.toSec();
+            if(stamp >= firstTime && stamp <= lastTime)
+            {
+                commands.push_back(routeCommands[j]);
+                commands.back().header.stamp = ros::Time(stamp + shift);
+            }
+        }
+
+        // The anchor points are named relative to the library, so that the
+        // clouds of different routes don't collide.
+        for(int j = leg.firstAnchor; j <= leg.lastAnchor; j++)
+        {
+            std::string name = leg.route + "/" + routeAnchorNames[j];
+            anchorPoints.push_back(AnchorPoint(name, routeAnchorPoses[j]));
+            anchorPoints.back().loadFromDisk(library.root());
+        }
+
+        legStartTime = lastTime + shift;
+    }
+
+    return !positions.empty() && !commands.empty() && !anchorPoints.empty();
+}
+
+size_t Repeat::closestPositionIndex(const std::vector<geometry_msgs::PoseStamped>& positions,
+                                    const geometry_msgs::Pose& pose, size_t from)
+{
+    size_t closest = from;
+    double closestDistance = std::numeric_limits<double>::infinity();
+
+    for(size_t i = from; i < positions.size(); i++)
+    {
+        double distance = geo_util::customDistance(positions[i].pose, pose);
+        if(distance < closestDistance)
+        {
+            closest = i;
+            closestDistance = distance;
+        }
+    }
+
+    return closest;
+}
+
 void Repeat::loadCommands(const std::string filename, std::vector<geometry_msgs::TwistStamped>& out)
 {
     std::ifstream commandFile(filename.c_str());
@@ -388,6 +732,7 @@ void Repeat::loadPositions(const std::string filename, std::vector<geometry_msgs
 void Repeat::loadAnchorPoints(const std::string filename, std::vector<AnchorPoint>& out)
 {
     std::ifstream anchorPointsFile(filename.c_str());
+    std::string directory = filename.substr(0, filename.find_last_of('/') + 1);
 
     if(anchorPointsFile.is_open())
     {
@@ -395,7 +740,7 @@ void Repeat::loadAnchorPoints(const std::string filename, std::vector<AnchorPoin
         while(std::getline(anchorPointsFile, lineBuffer))
         {
             out.push_back(AnchorPoint(lineBuffer));
-            out.back().loadFromDisk();
+            out.back().loadFromDisk(directory);
         }
         anchorPointsFile.close();
     } else {
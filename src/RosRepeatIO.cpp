@@ -0,0 +1,76 @@
+
+#include "husky_trainer/RosRepeatIO.h"
+
+const std::string RosRepeatIO::COMMAND_OUTPUT_TOPIC = "/teach_repeat/desired_command";
+const std::string RosRepeatIO::REFERENCE_POSE_TOPIC = "/teach_repeat/reference_pose";
+const std::string RosRepeatIO::ERROR_REPORTING_TOPIC = "/teach_repeat/raw_error";
+const std::string RosRepeatIO::CORRECTED_ERROR_TOPIC = "/teach_repeat/corrected_error";
+const std::string RosRepeatIO::AP_SWITCH_TOPIC = "/teach_repeat/ap_switch";
+const std::string RosRepeatIO::STATS_TOPIC = "/teach_repeat/repeat_stats";
+const std::string RosRepeatIO::LATENCY_PROBE_TOPIC = "/teach_repeat/latency_probe";
+const std::string RosRepeatIO::CLOUD_MATCHING_SERVICE = "/match_clouds";
+const std::string RosRepeatIO::PREPARED_CLOUD_MATCHING_SERVICE = "/match_prepared_clouds";
+const std::string RosRepeatIO::PREPARED_MATCHER_PARAM = "prepared_matcher";
+
+RosRepeatIO::RosRepeatIO(ros::NodeHandle& n)
+{
+    errorReportingTopic = n.advertise<husky_trainer::TrajectoryError>(ERROR_REPORTING_TOPIC, 1000);
+    correctedErrorTopic = n.advertise<husky_trainer::TrajectoryError>(CORRECTED_ERROR_TOPIC, 100);
+    commandRepeaterTopic = n.advertise<geometry_msgs::Twist>(COMMAND_OUTPUT_TOPIC, 1000);
+    referencePoseTopic = n.advertise<geometry_msgs::Pose>(REFERENCE_POSE_TOPIC, 100);
+    anchorPointSwitchTopic = n.advertise<husky_trainer::AnchorPointSwitch>(AP_SWITCH_TOPIC, 1000);
+    statsTopic = n.advertise<husky_trainer::RepeatStats>(STATS_TOPIC, 10);
+    latencyProbeTopic = n.advertise<husky_trainer::LatencyProbe>(LATENCY_PROBE_TOPIC, 100);
+
+    icpService = n.serviceClient<pointmatcher_ros::MatchClouds>(CLOUD_MATCHING_SERVICE, false);
+
+    n.param<bool>(PREPARED_MATCHER_PARAM, preparedMatcher, false);
+    if(preparedMatcher)
+    {
+        preparedIcpService =
+            n.serviceClient<pointmatcher_ros::MatchClouds>(PREPARED_CLOUD_MATCHING_SERVICE, false);
+    }
+}
+
+void RosRepeatIO::publishCommand(const geometry_msgs::Twist& command)
+{
+    commandRepeaterTopic.publish(command);
+}
+
+void RosRepeatIO::publishReferencePose(const geometry_msgs::Pose& pose)
+{
+    referencePoseTopic.publish(pose);
+}
+
+void RosRepeatIO::publishRawError(const husky_trainer::TrajectoryError& error)
+{
+    errorReportingTopic.publish(error);
+}
+
+void RosRepeatIO::publishCorrectedError(const husky_trainer::TrajectoryError& error)
+{
+    correctedErrorTopic.publish(error);
+}
+
+void RosRepeatIO::publishAnchorPointSwitch(const husky_trainer::AnchorPointSwitch& msg)
+{
+    anchorPointSwitchTopic.publish(msg);
+}
+
+void RosRepeatIO::publishStats(const husky_trainer::RepeatStats& stats)
+{
+    statsTopic.publish(stats);
+}
+
+void RosRepeatIO::publishLatencyProbe(const husky_trainer::LatencyProbe& probe)
+{
+    latencyProbeTopic.publish(probe);
+}
+
+// The prepared matcher skips the reference filters, the prepared clouds went
+// through them during the teach.
+bool RosRepeatIO::matchClouds(pointmatcher_ros::MatchClouds& match, bool preparedReference)
+{
+    if(preparedMatcher && preparedReference) return preparedIcpService.call(match);
+    return icpService.call(match);
+}
@@ -0,0 +1,381 @@
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <sstream>
+
+#include <ros/ros.h>
+
+#include "husky_trainer/AnchorPoint.h"
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/RouteGraph.h"
+
+#define GRAPH_SEP ','
+
+namespace
+{
+
+typedef std::pair<double, int> QueueEntry;
+typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > Queue;
+
+void relax(int node, int neighbour, double edgeCost, std::vector<double>& costs, std::vector<int>& previous,
+           Queue& queue)
+{
+    double cost = costs[node] + edgeCost;
+    if(cost < costs[neighbour])
+    {
+        costs[neighbour] = cost;
+        previous[neighbour] = node;
+        queue.push(QueueEntry(cost, neighbour));
+    }
+}
+
+}
+
+const std::string RouteGraph::GRAPH_FILE = "route_graph.rg";
+const double RouteGraph::SWITCH_PENALTY = 1.0;
+
+RouteGraph::RouteGraph()
+{
+    mNodeOffsets.push_back(0);
+}
+
+void RouteGraph::addRoute(const std::string& name, const std::vector<geometry_msgs::Pose>& anchorPoses)
+{
+    mRouteIndices[name] = mRouteNames.size();
+    mRouteNames.push_back(name);
+    mAnchorPoses.push_back(anchorPoses);
+    mNodeOffsets.push_back(mNodeOffsets.back() + anchorPoses.size());
+}
+
+// Read the anchor point poses of every route in the index of the library.
+bool RouteGraph::loadRoutes(const RouteLibrary& library)
+{
+    std::vector<RouteEntry> routes = library.routes();
+    bool success = true;
+
+    for(size_t i = 0; i < routes.size(); i++)
+    {
+        std::vector<geometry_msgs::Pose> anchorPoses;
+        if(loadAnchorPoses(RouteLibrary::joinPath(library.routeDirectory(routes[i].name),
+                                                  RouteLibrary::ANCHOR_POINTS_FILE),
+                           anchorPoses))
+        {
+            addRoute(routes[i].name, anchorPoses);
+        }
+        else
+        {
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+// Link every anchor point to the closest anchor point of each other route
+// that is within radius, according to geo_util::customDistance. The anchor
+// points are hashed in a grid of cells the size of the radius, so only the
+// neighbouring cells have to be searched.
+int RouteGraph::detectJunctions(double radius)
+{
+    typedef std::pair<long, long> Cell;
+    std::map<Cell, std::vector<int> > grid;
+    mJunctionEdges.clear();
+
+    if(radius <= 0.0) return 0;
+
+    for(size_t route = 0; route < mAnchorPoses.size(); route++)
+    {
+        for(size_t anchor = 0; anchor < mAnchorPoses[route].size(); anchor++)
+        {
+            const geometry_msgs::Point& p = mAnchorPoses[route][anchor].position;
+            Cell cell(static_cast<long>(floor(p.x / radius)), static_cast<long>(floor(p.y / radius)));
+            grid[cell].push_back(nodeOf(route, anchor));
+        }
+    }
+
+    for(int node = 0; node < nodeCount(); node++)
+    {
+        int route, anchor;
+        routeOfNode(node, route, anchor);
+        const geometry_msgs::Pose& pose = mAnchorPoses[route][anchor];
+
+        long cx = static_cast<long>(floor(pose.position.x / radius));
+        long cy = static_cast<long>(floor(pose.position.y / radius));
+
+        // Closest candidate for every other route.
+        std::map<int, std::pair<double, int> > closest;
+
+        for(long dx = -1; dx <= 1; dx++)
+        {
+            for(long dy = -1; dy <= 1; dy++)
+            {
+                std::map<Cell, std::vector<int> >::const_iterator cell =
+                    grid.find(Cell(cx + dx, cy + dy));
+                if(cell == grid.end()) continue;
+
+                for(size_t i = 0; i < cell->second.size(); i++)
+                {
+                    int otherRoute, otherAnchor;
+                    routeOfNode(cell->second[i], otherRoute, otherAnchor);
+
+                    // Each pair of routes is only looked at once.
+                    if(otherRoute <= route) continue;
+
+                    double distance = geo_util::customDistance(
+                            pose, mAnchorPoses[otherRoute][otherAnchor]);
+
+                    if(distance <= radius &&
+                       (closest.find(otherRoute) == closest.end() ||
+                        distance < closest[otherRoute].first))
+                    {
+                        closest[otherRoute] = std::make_pair(distance, cell->second[i]);
+                    }
+                }
+            }
+        }
+
+        for(std::map<int, std::pair<double, int> >::const_iterator it = closest.begin();
+            it != closest.end(); it++)
+        {
+            addJunction(node, it->second.second, it->second.first);
+        }
+    }
+
+    return mJunctionEdges.size();
+}
+
+bool RouteGraph::load(const std::string& filename)
+{
+    std::ifstream graphFile(filename.c_str());
+    mJunctionEdges.clear();
+
+    if(!graphFile.is_open())
+    {
+        ROS_ERROR_STREAM("Could not open route graph: " << filename);
+        return false;
+    }
+
+    std::string lineBuffer;
+    while(std::getline(graphFile, lineBuffer))
+    {
+        std::stringstream ss(lineBuffer);
+        std::string fromRoute, toRoute, buffer;
+        int fromAnchor, toAnchor;
+        double distance;
+
+        std::getline(ss, fromRoute, GRAPH_SEP);
+        std::getline(ss, buffer, GRAPH_SEP);
+        fromAnchor = strtol(buffer.c_str(), NULL, 10);
+        std::getline(ss, toRoute, GRAPH_SEP);
+        std::getline(ss, buffer, GRAPH_SEP);
+        toAnchor = strtol(buffer.c_str(), NULL, 10);
+        std::getline(ss, buffer);
+        distance = strtod(buffer.c_str(), NULL);
+
+        std::map<std::string, int>::const_iterator from = mRouteIndices.find(fromRoute);
+        std::map<std::string, int>::const_iterator to = mRouteIndices.find(toRoute);
+
+        if(from == mRouteIndices.end() || to == mRouteIndices.end() ||
+           fromAnchor < 0 || fromAnchor >= static_cast<int>(mAnchorPoses[from->second].size()) ||
+           toAnchor < 0 || toAnchor >= static_cast<int>(mAnchorPoses[to->second].size()))
+        {
+            ROS_WARN_STREAM("Ignoring junction to an unknown anchor point: " << lineBuffer);
+            continue;
+        }
+
+        addJunction(nodeOf(from->second, fromAnchor), nodeOf(to->second, toAnchor), distance);
+    }
+
+    return true;
+}
+
+bool RouteGraph::save(const std::string& filename) const
+{
+    std::ofstream graphFile(filename.c_str());
+    if(!graphFile.is_open())
+    {
+        ROS_ERROR_STREAM("Could not write route graph: " << filename);
+        return false;
+    }
+
+    std::vector<Junction> allJunctions = junctions();
+    for(size_t i = 0; i < allJunctions.size(); i++)
+    {
+        graphFile << allJunctions[i].fromRoute << GRAPH_SEP << allJunctions[i].fromAnchor << GRAPH_SEP <<
+            allJunctions[i].toRoute << GRAPH_SEP << allJunctions[i].toAnchor << GRAPH_SEP <<
+            allJunctions[i].distance << "\n";
+    }
+
+    return graphFile.good();
+}
+
+// Dijkstra over the anchor points, from one anchor point to another. The
+// resulting path is cut into legs at every route switch. A negative toAnchor
+// stands for the last anchor point of the route.
+bool RouteGraph::plan(const std::string& fromRoute, int fromAnchor,
+                      const std::string& toRoute, int toAnchor,
+                      std::vector<RouteLeg>& out) const
+{
+    out.clear();
+
+    std::map<std::string, int>::const_iterator from = mRouteIndices.find(fromRoute);
+    std::map<std::string, int>::const_iterator to = mRouteIndices.find(toRoute);
+    if(from == mRouteIndices.end() || to == mRouteIndices.end()) return false;
+
+    if(toAnchor < 0) toAnchor = mAnchorPoses[to->second].size() - 1;
+    if(fromAnchor < 0 || fromAnchor >= static_cast<int>(mAnchorPoses[from->second].size()) ||
+       toAnchor < 0 || toAnchor >= static_cast<int>(mAnchorPoses[to->second].size()))
+    {
+        return false;
+    }
+
+    std::vector<std::vector<std::pair<int, double> > > junctionsOfNode(nodeCount());
+    for(size_t i = 0; i < mJunctionEdges.size(); i++)
+    {
+        double cost = mJunctionEdges[i].cost + SWITCH_PENALTY;
+        junctionsOfNode[mJunctionEdges[i].from].push_back(std::make_pair(mJunctionEdges[i].to, cost));
+        junctionsOfNode[mJunctionEdges[i].to].push_back(std::make_pair(mJunctionEdges[i].from, cost));
+    }
+
+    int start = nodeOf(from->second, fromAnchor);
+    int goal = nodeOf(to->second, toAnchor);
+
+    std::vector<double> costs(nodeCount(), std::numeric_limits<double>::infinity());
+    std::vector<int> previous(nodeCount(), -1);
+    Queue queue;
+
+    costs[start] = 0.0;
+    queue.push(QueueEntry(0.0, start));
+
+    while(!queue.empty())
+    {
+        QueueEntry current = queue.top();
+        queue.pop();
+
+        int node = current.second;
+        if(node == goal) break;
+        if(current.first > costs[node]) continue;
+
+        int route, anchor;
+        routeOfNode(node, route, anchor);
+
+        const std::vector<std::pair<int, double> >& junctions = junctionsOfNode[node];
+        for(size_t i = 0; i < junctions.size(); i++)
+        {
+            relax(node, junctions[i].first, junctions[i].second, costs, previous, queue);
+        }
+
+        if(anchor + 1 < static_cast<int>(mAnchorPoses[route].size()))
+        {
+            relax(node, node + 1,
+                  geo_util::euclidian_distance_of_poses(mAnchorPoses[route][anchor], mAnchorPoses[route][anchor + 1]),
+                  costs, previous, queue);
+        }
+    }
+
+    if(costs[goal] == std::numeric_limits<double>::infinity()) return false;
+
+    std::vector<int> path;
+    for(int node = goal; node != -1; node = previous[node])
+    {
+        path.push_back(node);
+    }
+    std::reverse(path.begin(), path.end());
+
+    for(size_t i = 0; i < path.size(); i++)
+    {
+        int route, anchor;
+        routeOfNode(path[i], route, anchor);
+
+        if(out.empty() || out.back().route != mRouteNames[route])
+        {
+            RouteLeg leg;
+            leg.route = mRouteNames[route];
+            leg.firstAnchor = anchor;
+            leg.lastAnchor = anchor;
+            out.push_back(leg);
+        }
+        else
+        {
+            out.back().lastAnchor = anchor;
+        }
+    }
+
+    return true;
+}
+
+int RouteGraph::anchorCount(const std::string& route) const
+{
+    std::map<std::string, int>::const_iterator it = mRouteIndices.find(route);
+    return it == mRouteIndices.end() ? 0 : mAnchorPoses[it->second].size();
+}
+
+std::vector<Junction> RouteGraph::junctions() const
+{
+    std::vector<Junction> out;
+    for(size_t i = 0; i < mJunctionEdges.size(); i++)
+    {
+        int fromRoute, fromAnchor, toRoute, toAnchor;
+        routeOfNode(mJunctionEdges[i].from, fromRoute, fromAnchor);
+        routeOfNode(mJunctionEdges[i].to, toRoute, toAnchor);
+
+        Junction junction;
+        junction.fromRoute = mRouteNames[fromRoute];
+        junction.fromAnchor = fromAnchor;
+        junction.toRoute = mRouteNames[toRoute];
+        junction.toAnchor = toAnchor;
+        junction.distance = mJunctionEdges[i].cost;
+        out.push_back(junction);
+    }
+    return out;
+}
+
+bool RouteGraph::loadAnchorPoses(const std::string& filename, std::vector<geometry_msgs::Pose>& out)
+{
+    std::ifstream anchorPointsFile(filename.c_str());
+    out.clear();
+
+    if(!anchorPointsFile.is_open())
+    {
+        ROS_ERROR_STREAM("Could not open anchor points file: " << filename);
+        return false;
+    }
+
+    std::string lineBuffer;
+    while(std::getline(anchorPointsFile, lineBuffer))
+    {
+        if(lineBuffer.empty()) continue;
+        out.push_back(AnchorPoint(lineBuffer).getPosition());
+    }
+
+    return true;
+}
+
+int RouteGraph::nodeOf(int route, int anchor) const
+{
+    return mNodeOffsets[route] + anchor;
+}
+
+void RouteGraph::routeOfNode(int node, int& route, int& anchor) const
+{
+    route = std::upper_bound(mNodeOffsets.begin(), mNodeOffsets.end(), node) - mNodeOffsets.begin() - 1;
+    anchor = node - mNodeOffsets[route];
+}
+
+int RouteGraph::nodeCount() const
+{
+    return mNodeOffsets.back();
+}
+
+void RouteGraph::addJunction(int fromNode, int toNode, double distance)
+{
+    Edge edge;
+    edge.from = fromNode;
+    edge.to = toNode;
+    edge.cost = distance;
+    mJunctionEdges.push_back(edge);
+}
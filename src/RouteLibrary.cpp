@@ -0,0 +1,272 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <ros/ros.h>
+
+#include "husky_trainer/RouteLibrary.h"
+
+#define INDEX_SEP ','
+#define INDEX_PRECISION 17
+
+const std::string RouteLibrary::INDEX_FILE = "routes.idx";
+const std::string RouteLibrary::POSITIONS_FILE = "positions.pl";
+const std::string RouteLibrary::COMMANDS_FILE = "speeds.sl";
+const std::string RouteLibrary::ANCHOR_POINTS_FILE = "anchorPoints.apd";
+const std::string RouteLibrary::START_TIME_FILE = "teach.start";
+
+namespace
+{
+
+bool isCloserThan(const std::pair<double, RouteEntry>& lhs,
+                  const std::pair<double, RouteEntry>& rhs)
+{
+    return lhs.first < rhs.first;
+}
+
+}
+
+RouteEntry::RouteEntry() :
+    anchorCount(0),
+    minX(std::numeric_limits<double>::infinity()),
+    minY(std::numeric_limits<double>::infinity()),
+    maxX(-std::numeric_limits<double>::infinity()),
+    maxY(-std::numeric_limits<double>::infinity())
+{ }
+
+// Distance from a point to the bounding box of the route, 0 if inside.
+double RouteEntry::distanceTo(double x, double y) const
+{
+    double dx = std::max(0.0, std::max(minX - x, x - maxX));
+    double dy = std::max(0.0, std::max(minY - y, y - maxY));
+    return sqrt(dx*dx + dy*dy);
+}
+
+// The extents are written with all their digits, routes can be far from the
+// origin of the odometry.
+std::ostream& operator<<(std::ostream& out, const RouteEntry& entry)
+{
+    std::streamsize precision = out.precision(INDEX_PRECISION);
+    out << entry.name << INDEX_SEP << entry.anchorCount << INDEX_SEP <<
+        entry.minX << INDEX_SEP << entry.minY << INDEX_SEP <<
+        entry.maxX << INDEX_SEP << entry.maxY << std::endl;
+    out.precision(precision);
+    return out;
+}
+
+std::istream& operator>>(std::istream& in, RouteEntry& entry)
+{
+    std::string line;
+    if(!std::getline(in, line)) return in;
+
+    std::stringstream ss(line);
+    std::string buffer;
+
+    std::getline(ss, entry.name, INDEX_SEP);
+
+    std::getline(ss, buffer, INDEX_SEP);
+    entry.anchorCount = strtoul(buffer.c_str(), NULL, 10);
+
+    double* extents[] = {&entry.minX, &entry.minY, &entry.maxX, &entry.maxY};
+    for(int i = 0; i < 4; i++)
+    {
+        std::getline(ss, buffer, INDEX_SEP);
+        *extents[i] = strtod(buffer.c_str(), NULL);
+    }
+
+    if(entry.name.empty()) in.setstate(std::ios::failbit);
+    return in;
+}
+
+RouteLibrary::RouteLibrary(const std::string& root) :
+    mRoot(root)
+{ }
+
+bool RouteLibrary::loadIndex()
+{
+    std::ifstream indexFile(joinPath(mRoot, INDEX_FILE).c_str());
+    mRoutes.clear();
+
+    if(!indexFile.is_open())
+    {
+        ROS_WARN_STREAM("Could not open route index in: " << mRoot);
+        return false;
+    }
+
+    RouteEntry entry;
+    while(indexFile >> entry)
+    {
+        mRoutes[entry.name] = entry;
+    }
+
+    return true;
+}
+
+bool RouteLibrary::saveIndex() const
+{
+    // Write to a temporary file first so that a reader never sees a
+    // partially written index.
+    std::string indexPath = joinPath(mRoot, INDEX_FILE);
+    std::string temporaryPath = indexPath + ".tmp";
+
+    std::ofstream indexFile(temporaryPath.c_str());
+    if(!indexFile.is_open())
+    {
+        ROS_ERROR_STREAM("Could not write route index in: " << mRoot);
+        return false;
+    }
+
+    for(std::map<std::string, RouteEntry>::const_iterator it = mRoutes.begin();
+        it != mRoutes.end(); it++)
+    {
+        indexFile << it->second;
+    }
+    indexFile.close();
+
+    return rename(temporaryPath.c_str(), indexPath.c_str()) == 0;
+}
+
+std::string RouteLibrary::root() const
+{
+    return mRoot;
+}
+
+std::string RouteLibrary::routeDirectory(const std::string& name) const
+{
+    return joinPath(mRoot, name);
+}
+
+bool RouteLibrary::findRoute(const std::string& name, RouteEntry& out) const
+{
+    std::map<std::string, RouteEntry>::const_iterator it = mRoutes.find(name);
+    if(it == mRoutes.end()) return false;
+
+    out = it->second;
+    return true;
+}
+
+std::vector<RouteEntry> RouteLibrary::routes() const
+{
+    std::vector<RouteEntry> out;
+    for(std::map<std::string, RouteEntry>::const_iterator it = mRoutes.begin();
+        it != mRoutes.end(); it++)
+    {
+        out.push_back(it->second);
+    }
+    return out;
+}
+
+// Routes whose extents come within radius of the pose, closest first.
+std::vector<RouteEntry> RouteLibrary::routesNear(const geometry_msgs::Pose& pose, double radius) const
+{
+    std::vector<std::pair<double, RouteEntry> > candidates;
+    for(std::map<std::string, RouteEntry>::const_iterator it = mRoutes.begin();
+        it != mRoutes.end(); it++)
+    {
+        double distance = it->second.distanceTo(pose.position.x, pose.position.y);
+        if(distance <= radius)
+        {
+            candidates.push_back(std::make_pair(distance, it->second));
+        }
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), isCloserThan);
+
+    std::vector<RouteEntry> out;
+    for(size_t i = 0; i < candidates.size(); i++)
+    {
+        out.push_back(candidates[i].second);
+    }
+    return out;
+}
+
+// The name is a field of the index, it can't hold a separator.
+bool RouteLibrary::indexRoute(const std::string& name)
+{
+    if(name.empty() || name.find_first_of(std::string(1, INDEX_SEP) + "\n") != std::string::npos)
+    {
+        ROS_WARN_STREAM("Invalid route name: " << name);
+        return false;
+    }
+
+    RouteEntry entry;
+    if(!summarizeRoute(name, routeDirectory(name), entry)) return false;
+
+    mRoutes[name] = entry;
+    return true;
+}
+
+void RouteLibrary::removeRoute(const std::string& name)
+{
+    mRoutes.erase(name);
+}
+
+// Rebuild the whole index from the route directories. Returns the number of
+// routes found.
+int RouteLibrary::rebuildIndex()
+{
+    namespace fs = boost::filesystem;
+    mRoutes.clear();
+
+    fs::path rootPath(mRoot.empty() ? "." : mRoot);
+    if(!fs::is_directory(rootPath)) return 0;
+
+    for(fs::directory_iterator it(rootPath); it != fs::directory_iterator(); it++)
+    {
+        if(fs::is_directory(it->status()) &&
+           fs::exists(it->path() / ANCHOR_POINTS_FILE))
+        {
+            indexRoute(it->path().filename().string());
+        }
+    }
+
+    return mRoutes.size();
+}
+
+bool RouteLibrary::summarizeRoute(const std::string& name, const std::string& directory, RouteEntry& out)
+{
+    std::ifstream positionFile(joinPath(directory, POSITIONS_FILE).c_str());
+    std::ifstream anchorPointsFile(joinPath(directory, ANCHOR_POINTS_FILE).c_str());
+
+    if(!positionFile.is_open() || !anchorPointsFile.is_open())
+    {
+        ROS_WARN_STREAM("Could not summarize route: " << name);
+        return false;
+    }
+
+    out = RouteEntry();
+    out.name = name;
+
+    // Only the x and y of the positions are needed, which follow the time
+    // stamp on every line.
+    std::string lineBuffer;
+    while(std::getline(positionFile, lineBuffer))
+    {
+        double time, x, y;
+        if(sscanf(lineBuffer.c_str(), "%lf,%lf,%lf", &time, &x, &y) != 3) continue;
+
+        out.minX = std::min(out.minX, x);
+        out.minY = std::min(out.minY, y);
+        out.maxX = std::max(out.maxX, x);
+        out.maxY = std::max(out.maxY, y);
+    }
+
+    while(std::getline(anchorPointsFile, lineBuffer))
+    {
+        if(!lineBuffer.empty()) out.anchorCount++;
+    }
+
+    return true;
+}
+
+std::string RouteLibrary::joinPath(const std::string& directory, const std::string& filename)
+{
+    if(directory.empty()) return filename;
+    if(directory[directory.size() - 1] == '/') return directory + filename;
+    return directory + "/" + filename;
+}
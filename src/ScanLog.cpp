@@ -0,0 +1,332 @@
+
+#include <algorithm>
+#include <cstring>
+
+#include "husky_trainer/CloudCompression.h"
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/ScanLog.h"
+
+#define SCAN_LOG_MAGIC "HTSL"
+#define SCAN_LOG_VERSION 1
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+namespace scan_log
+{
+const std::string DATA_FILE = "scans.slog";
+const std::string INDEX_FILE = "scans.sidx";
+}
+
+namespace
+{
+
+bool isEarlierThan(const scan_log::IndexEntry& entry, double stamp)
+{
+    return entry.stamp < stamp;
+}
+
+bool isEarlierThanEntry(const scan_log::IndexEntry& lhs, const scan_log::IndexEntry& rhs)
+{
+    return lhs.stamp < rhs.stamp;
+}
+
+}
+
+ScanLogWriter::ScanLogWriter(const std::string& directory, const Eigen::Matrix4f& lidarToRobot,
+                             float resolution, size_t capacity) :
+    mOffset(0), mResolution(resolution), mCapacity(capacity), mStopping(false),
+    mPaused(false), mLogged(0), mDropped(0)
+{
+    mDataFile = fopen(RouteLibrary::joinPath(directory, scan_log::DATA_FILE).c_str(), "wb");
+    mIndexFile = fopen(RouteLibrary::joinPath(directory, scan_log::INDEX_FILE).c_str(), "wb");
+
+    if(!isOpen())
+    {
+        ROS_ERROR("Could not create the scan log, scans will not be logged.");
+        return;
+    }
+
+    setvbuf(mDataFile, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+    scan_log::FileHeader header;
+    memcpy(header.magic, SCAN_LOG_MAGIC, sizeof(header.magic));
+    header.version = SCAN_LOG_VERSION;
+    for(int i = 0; i < 16; i++)
+    {
+        header.lidarToRobot[i] = lidarToRobot(i / 4, i % 4);
+    }
+
+    fwrite(&header, sizeof(header), 1, mDataFile);
+    mOffset = sizeof(header);
+
+    mThread = boost::thread(&ScanLogWriter::work, this);
+}
+
+ScanLogWriter::~ScanLogWriter()
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mStopping = true;
+    }
+    mScanAvailable.notify_all();
+
+    if(mThread.joinable()) mThread.join();
+
+    if(mDataFile) fclose(mDataFile);
+    if(mIndexFile) fclose(mIndexFile);
+
+    if(mDropped > 0)
+    {
+        ROS_WARN_STREAM("The scan log dropped " << mDropped << " scans.");
+    }
+}
+
+bool ScanLogWriter::isOpen() const
+{
+    return mDataFile != NULL && mIndexFile != NULL;
+}
+
+// Queue a scan for writing. Returns false if the scan was dropped.
+bool ScanLogWriter::log(const sensor_msgs::PointCloud2ConstPtr& scan, const geometry_msgs::Pose& pose)
+{
+    if(!isOpen()) return false;
+
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        if(mPaused) return false;
+
+        if(mQueue.size() >= mCapacity)
+        {
+            mDropped++;
+            return false;
+        }
+
+        PendingScan pending;
+        pending.scan = scan;
+        pending.pose = pose;
+        mQueue.push_back(pending);
+    }
+
+    mScanAvailable.notify_one();
+    return true;
+}
+
+void ScanLogWriter::setPaused(bool paused)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    mPaused = paused;
+}
+
+bool ScanLogWriter::isPaused() const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mPaused;
+}
+
+uint64_t ScanLogWriter::loggedCount() const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mLogged;
+}
+
+uint64_t ScanLogWriter::droppedCount() const
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mDropped;
+}
+
+void ScanLogWriter::work()
+{
+    while(true)
+    {
+        PendingScan pending;
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            if(mQueue.empty() && !mStopping)
+            {
+                // Nothing left to write, a good time to hit the disk. The
+                // lock is released so that logging never waits on the flush.
+                lock.unlock();
+                fflush(mDataFile);
+                fflush(mIndexFile);
+                lock.lock();
+            }
+
+            while(mQueue.empty() && !mStopping)
+            {
+                mScanAvailable.wait(lock);
+            }
+
+            if(mQueue.empty()) return;
+
+            pending = mQueue.front();
+            mQueue.pop_front();
+        }
+
+        bool written = write(pending);
+
+        boost::mutex::scoped_lock lock(mMutex);
+        if(written) mLogged++;
+        else mDropped++;
+    }
+}
+
+bool ScanLogWriter::write(const PendingScan& pending)
+{
+    std::vector<float> xyz;
+    std::vector<uint8_t> data;
+    if(!cloud_compression::extractPoints(*pending.scan, xyz) ||
+       !cloud_compression::encodePoints(xyz, mResolution, data))
+    {
+        return false;
+    }
+
+    scan_log::RecordHeader record;
+    record.stamp = pending.scan->header.stamp.toSec();
+    record.pose[0] = pending.pose.position.x;
+    record.pose[1] = pending.pose.position.y;
+    record.pose[2] = pending.pose.position.z;
+    record.pose[3] = pending.pose.orientation.x;
+    record.pose[4] = pending.pose.orientation.y;
+    record.pose[5] = pending.pose.orientation.z;
+    record.pose[6] = pending.pose.orientation.w;
+    record.resolution = mResolution;
+    record.pointCount = xyz.size() / 3;
+    record.dataSize = data.size();
+    record.reserved = 0;
+
+    scan_log::IndexEntry entry;
+    entry.stamp = record.stamp;
+    entry.offset = mOffset;
+    entry.x = pending.pose.position.x;
+    entry.y = pending.pose.position.y;
+    entry.yaw = geo_util::quatTo2dYaw(pending.pose.orientation);
+
+    if(fwrite(&record, sizeof(record), 1, mDataFile) != 1 ||
+       (!data.empty() && fwrite(&data[0], data.size(), 1, mDataFile) != 1) ||
+       fwrite(&entry, sizeof(entry), 1, mIndexFile) != 1)
+    {
+        ROS_ERROR_THROTTLE(1.0, "Could not write to the scan log.");
+        return false;
+    }
+
+    mOffset += sizeof(record) + data.size();
+    return true;
+}
+
+ScanLogReader::ScanLogReader() :
+    mDataFile(NULL)
+{ }
+
+ScanLogReader::~ScanLogReader()
+{
+    if(mDataFile) fclose(mDataFile);
+}
+
+bool ScanLogReader::open(const std::string& directory)
+{
+    if(mDataFile) fclose(mDataFile);
+    mIndex.clear();
+
+    mDataFile = fopen(RouteLibrary::joinPath(directory, scan_log::DATA_FILE).c_str(), "rb");
+    FILE* indexFile = fopen(RouteLibrary::joinPath(directory, scan_log::INDEX_FILE).c_str(), "rb");
+
+    bool valid = mDataFile != NULL && indexFile != NULL &&
+        fread(&mHeader, sizeof(mHeader), 1, mDataFile) == 1 &&
+        memcmp(mHeader.magic, SCAN_LOG_MAGIC, sizeof(mHeader.magic)) == 0 &&
+        mHeader.version == SCAN_LOG_VERSION;
+
+    scan_log::IndexEntry entry;
+    while(valid && fread(&entry, sizeof(entry), 1, indexFile) == 1)
+    {
+        mIndex.push_back(entry);
+    }
+
+    if(indexFile) fclose(indexFile);
+
+    // The scans are not always written in time order, the index has to be.
+    std::stable_sort(mIndex.begin(), mIndex.end(), isEarlierThanEntry);
+
+    return valid;
+}
+
+size_t ScanLogReader::size() const
+{
+    return mIndex.size();
+}
+
+const scan_log::IndexEntry& ScanLogReader::entry(size_t i) const
+{
+    return mIndex[i];
+}
+
+// Index of the first scan taken at or after the given time.
+size_t ScanLogReader::indexOfTime(ros::Time time) const
+{
+    return std::lower_bound(mIndex.begin(), mIndex.end(), time.toSec(), isEarlierThan) - mIndex.begin();
+}
+
+bool ScanLogReader::readPose(size_t i, geometry_msgs::Pose& pose)
+{
+    scan_log::RecordHeader record;
+    if(!readRecordHeader(i, record)) return false;
+
+    pose = poseOfRecord(record);
+    return true;
+}
+
+bool ScanLogReader::readScan(size_t i, sensor_msgs::PointCloud2& scan, geometry_msgs::Pose& pose)
+{
+    scan_log::RecordHeader record;
+    if(!readRecordHeader(i, record)) return false;
+
+    std::vector<uint8_t> data(record.dataSize);
+    if(!data.empty() && fread(&data[0], data.size(), 1, mDataFile) != 1)
+    {
+        return false;
+    }
+
+    std::vector<float> xyz;
+    if(!cloud_compression::decodePoints(data, record.resolution, record.pointCount, xyz))
+    {
+        return false;
+    }
+
+    std_msgs::Header header;
+    header.stamp = ros::Time(record.stamp);
+    scan = cloud_compression::cloudOfPoints(xyz, header);
+    pose = poseOfRecord(record);
+
+    return true;
+}
+
+Eigen::Matrix4f ScanLogReader::lidarToRobot() const
+{
+    Eigen::Matrix4f transform;
+    for(int i = 0; i < 16; i++)
+    {
+        transform(i / 4, i % 4) = mHeader.lidarToRobot[i];
+    }
+    return transform;
+}
+
+// Leaves the data file positioned at the start of the compressed points.
+bool ScanLogReader::readRecordHeader(size_t i, scan_log::RecordHeader& record)
+{
+    return mDataFile != NULL && i < mIndex.size() &&
+        fseeko(mDataFile, mIndex[i].offset, SEEK_SET) == 0 &&
+        fread(&record, sizeof(record), 1, mDataFile) == 1;
+}
+
+geometry_msgs::Pose ScanLogReader::poseOfRecord(const scan_log::RecordHeader& record)
+{
+    geometry_msgs::Pose pose;
+    pose.position.x = record.pose[0];
+    pose.position.y = record.pose[1];
+    pose.position.z = record.pose[2];
+    pose.orientation.x = record.pose[3];
+    pose.orientation.y = record.pose[4];
+    pose.orientation.z = record.pose[5];
+    pose.orientation.w = record.pose[6];
+    return pose;
+}
@@ -0,0 +1,288 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include <tf/transform_datatypes.h>
+
+#include "husky_trainer/SyntheticRoute.h"
+#include "husky_trainer/CloudCompression.h"
+#include "husky_trainer/CloudIO.h"
+#include "husky_trainer/CloudPreparation.h"
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/WorkerPool.h"
+
+#define POSITION_PERIOD 0.1
+#define JOBS_PER_THREAD 2
+#define L_SEP ","
+
+// The pillar field.
+#define CELL_SIZE 2.0
+#define PILLAR_DENSITY 0.2
+#define PILLAR_HEIGHT 2.0
+#define MIN_PILLAR_RADIUS 0.1
+#define MAX_PILLAR_RADIUS 0.3
+#define MIN_PILLAR_DISTANCE 1.0
+#define GROUND_FRACTION 0.2
+
+// The path, two sinusoids of curvature in 1/m with their periods in m.
+#define FIRST_CURVATURE 0.05
+#define FIRST_PERIOD 60.0
+#define SECOND_CURVATURE 0.03
+#define SECOND_PERIOD 17.0
+
+typedef PointMatcher<float> PM;
+typedef boost::variate_generator<boost::mt19937&, boost::uniform_real<> > Uniform;
+
+namespace
+{
+
+struct Pillar {
+    double x, y, radius;
+};
+
+uint64_t mix(uint64_t value)
+{
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+geometry_msgs::Pose planarPose(double x, double y, double yaw)
+{
+    geometry_msgs::Pose pose;
+    pose.position.x = x;
+    pose.position.y = y;
+    pose.orientation = tf::createQuaternionMsgFromYaw(yaw);
+    return pose;
+}
+
+}
+
+SyntheticRoute::SyntheticRoute(unsigned int seed, double anchorDistance, double speed) :
+    mSeed(seed), mAnchorDistance(anchorDistance), mSpeed(speed), mPointCount(DEFAULT_SYNTHETIC_POINTS),
+    mRange(DEFAULT_SYNTHETIC_RANGE), mTileLength(DEFAULT_SYNTHETIC_TILE_LENGTH)
+{ }
+
+void SyntheticRoute::setPointCount(size_t pointCount)
+{
+    mPointCount = pointCount;
+}
+
+void SyntheticRoute::setRange(double range)
+{
+    mRange = range;
+}
+
+bool SyntheticRoute::setTemplate(const sensor_msgs::PointCloud2& cloud, double tileLength)
+{
+    mTileLength = tileLength;
+    return cloud_compression::extractPoints(cloud, mTemplate) && !mTemplate.empty();
+}
+
+std::string SyntheticRoute::anchorPointName(size_t index)
+{
+    std::stringstream ss;
+    ss.fill('0');
+    ss << std::setw(6) << index << ".pcd";
+    return ss.str();
+}
+
+// Walks the path one position period at a time, writing the trajectory as
+// the teach would and handing the clouds of the anchor points to the pool.
+bool SyntheticRoute::write(const std::string& directory, size_t anchorCount, unsigned int threadCount) const
+{
+    if(anchorCount == 0 || mAnchorDistance <= 0.0 || mSpeed <= 0.0) return false;
+
+    boost::system::error_code error;
+    boost::filesystem::create_directories(directory, error);
+    if(error) return false;
+
+    FILE* positions = fopen(RouteLibrary::joinPath(directory, RouteLibrary::POSITIONS_FILE).c_str(), "w");
+    FILE* commands = fopen(RouteLibrary::joinPath(directory, RouteLibrary::COMMANDS_FILE).c_str(), "w");
+    std::ofstream anchorPoints(RouteLibrary::joinPath(directory, RouteLibrary::ANCHOR_POINTS_FILE).c_str());
+
+    bool opened = positions != NULL && commands != NULL && anchorPoints.is_open();
+    boost::atomic<unsigned int> failures(0);
+    const double step = mSpeed * POSITION_PERIOD;
+
+    if(opened)
+    {
+        WorkerPool pool(threadCount, JOBS_PER_THREAD * threadCount);
+
+        double x = 0.0, y = 0.0, yaw = 0.0;
+        geometry_msgs::Pose tile = planarPose(x, y, yaw);
+        size_t anchors = 0;
+        size_t tiles = 1;
+
+        for(size_t i = 0; anchors < anchorCount; i++)
+        {
+            double distance = i * step;
+            double time = i * POSITION_PERIOD;
+            geometry_msgs::Pose pose = planarPose(x, y, yaw);
+
+            if(distance + 0.5 * step >= tiles * mTileLength)
+            {
+                tile = pose;
+                tiles++;
+            }
+
+            fprintf(positions, "%.17g" L_SEP "%g" L_SEP "%g" L_SEP "%g" L_SEP "%g" L_SEP "%g" L_SEP "%g" L_SEP "%g\n",
+                    time, pose.position.x, pose.position.y, pose.position.z, pose.orientation.x,
+                    pose.orientation.y, pose.orientation.z, pose.orientation.w);
+            fprintf(commands, "%.17g" L_SEP "%g" L_SEP "%g\n", time, mSpeed, mSpeed * curvature(distance));
+
+            if(distance + 0.5 * step >= anchors * mAnchorDistance)
+            {
+                std::string name = anchorPointName(anchors);
+                anchorPoints << name << L_SEP << geo_util::poseToString(pose);
+                pool.post(boost::bind(&SyntheticRoute::writeScan, this, pose, tile, anchors,
+                                      RouteLibrary::joinPath(directory, name), boost::ref(failures)));
+                anchors++;
+            }
+
+            // Midpoint rule, the heading halfway through the step.
+            double halfway = yaw + 0.5 * step * curvature(distance);
+            x += step * cos(halfway);
+            y += step * sin(halfway);
+            yaw += step * curvature(distance + 0.5 * step);
+        }
+    }
+
+    if(positions != NULL) fclose(positions);
+    if(commands != NULL) fclose(commands);
+
+    return opened && failures == 0;
+}
+
+double SyntheticRoute::curvature(double distance) const
+{
+    double firstPhase = 2.0 * M_PI * (mSeed % 1000) / 1000.0;
+    double secondPhase = 2.0 * M_PI * (mSeed / 1000 % 1000) / 1000.0;
+
+    return FIRST_CURVATURE * sin(2.0 * M_PI * distance / FIRST_PERIOD + firstPhase) +
+        SECOND_CURVATURE * sin(2.0 * M_PI * distance / SECOND_PERIOD + secondPhase);
+}
+
+void SyntheticRoute::writeScan(const geometry_msgs::Pose& pose, const geometry_msgs::Pose& tile, size_t index,
+                               const std::string& filename, boost::atomic<unsigned int>& failures) const
+{
+    std::vector<float> xyz;
+    if(mTemplate.empty())
+    {
+        pillarPoints(pose, index, xyz);
+    }
+    else
+    {
+        templatePoints(pose, tile, xyz);
+    }
+
+    std_msgs::Header header;
+    header.frame_id = "/base_link";
+    if(!cloud_io::writePcd(filename, cloud_compression::cloudOfPoints(xyz, header), false))
+    {
+        failures++;
+    }
+
+    // A prepared cloud left by an earlier route of the same name is not of
+    // this one.
+    boost::system::error_code error;
+    boost::filesystem::remove(CloudPreparation::preparedFileOf(filename), error);
+}
+
+// The pillars are seen whole, without occlusions. The points are drawn anew
+// for every anchor point, like the beams of a lidar fall in different places
+// from one scan to the next.
+void SyntheticRoute::pillarPoints(const geometry_msgs::Pose& pose, size_t index, std::vector<float>& xyz) const
+{
+    std::vector<Pillar> pillars;
+
+    double yaw = tf::getYaw(pose.orientation);
+    double c = cos(yaw), s = sin(yaw);
+
+    int64_t minI = static_cast<int64_t>(floor((pose.position.x - mRange) / CELL_SIZE));
+    int64_t maxI = static_cast<int64_t>(floor((pose.position.x + mRange) / CELL_SIZE));
+    int64_t minJ = static_cast<int64_t>(floor((pose.position.y - mRange) / CELL_SIZE));
+    int64_t maxJ = static_cast<int64_t>(floor((pose.position.y + mRange) / CELL_SIZE));
+
+    for(int64_t i = minI; i <= maxI; i++)
+    {
+        for(int64_t j = minJ; j <= maxJ; j++)
+        {
+            if(cellHash(i, j, 0) >= PILLAR_DENSITY) continue;
+
+            double dx = (i + cellHash(i, j, 1)) * CELL_SIZE - pose.position.x;
+            double dy = (j + cellHash(i, j, 2)) * CELL_SIZE - pose.position.y;
+            double distance = sqrt(dx * dx + dy * dy);
+            if(distance > mRange || distance < MIN_PILLAR_DISTANCE) continue;
+
+            Pillar pillar;
+            pillar.x = c * dx + s * dy;
+            pillar.y = -s * dx + c * dy;
+            pillar.radius = MIN_PILLAR_RADIUS + (MAX_PILLAR_RADIUS - MIN_PILLAR_RADIUS) * cellHash(i, j, 3);
+            pillars.push_back(pillar);
+        }
+    }
+
+    boost::mt19937 generator(static_cast<uint32_t>(mix(mSeed ^ mix(index))));
+    Uniform unit(generator, boost::uniform_real<>(0.0, 1.0));
+
+    size_t groundCount = pillars.empty() ? mPointCount : static_cast<size_t>(GROUND_FRACTION * mPointCount);
+    xyz.reserve(3 * mPointCount);
+
+    for(size_t k = 0; k < groundCount; k++)
+    {
+        double r = mRange * sqrt(unit());
+        double a = 2.0 * M_PI * unit();
+        xyz.push_back(r * cos(a));
+        xyz.push_back(r * sin(a));
+        xyz.push_back(0.0);
+    }
+
+    for(size_t k = 0; k < mPointCount - groundCount; k++)
+    {
+        const Pillar& pillar = pillars[k % pillars.size()];
+        double a = 2.0 * M_PI * unit();
+        xyz.push_back(pillar.x + pillar.radius * cos(a));
+        xyz.push_back(pillar.y + pillar.radius * sin(a));
+        xyz.push_back(PILLAR_HEIGHT * unit());
+    }
+}
+
+// The template is thinned out to the point count, then moved from the tile
+// to the frame of the anchor point.
+void SyntheticRoute::templatePoints(const geometry_msgs::Pose& pose, const geometry_msgs::Pose& tile,
+                                    std::vector<float>& xyz) const
+{
+    PM::TransformationParameters tileToAnchor =
+        geo_util::pmTransOfPose(pose).inverse() * geo_util::pmTransOfPose(tile);
+
+    size_t templateSize = mTemplate.size() / 3;
+    size_t stride = mPointCount > 0 && templateSize > mPointCount ? templateSize / mPointCount : 1;
+    xyz.reserve(3 * (templateSize / stride + 1));
+
+    for(size_t k = 0; k < templateSize; k += stride)
+    {
+        Eigen::Vector4f point(mTemplate[3 * k], mTemplate[3 * k + 1], mTemplate[3 * k + 2], 1.0);
+        Eigen::Vector4f moved = tileToAnchor * point;
+        xyz.push_back(moved(0));
+        xyz.push_back(moved(1));
+        xyz.push_back(moved(2));
+    }
+}
+
+// Uniform in [0, 1), the same for a cell every time.
+double SyntheticRoute::cellHash(int64_t i, int64_t j, uint64_t salt) const
+{
+    uint64_t h = mix(mix(mix(static_cast<uint64_t>(i)) ^ static_cast<uint64_t>(j)) ^ (salt << 32 | mSeed));
+    return (h >> 11) * (1.0 / 9007199254740992.0);
+}
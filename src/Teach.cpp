@@ -0,0 +1,675 @@
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+#include <tf/transform_listener.h>
+
+#include "pointmatcher_ros/point_cloud.h"
+#include "pointmatcher_ros/transform.h"
+
+#include "husky_trainer/Teach.h"
+#include "husky_trainer/PointMatching.h"
+#include "husky_trainer/NamedPointCloud.h"
+#include "husky_trainer/CompressedNamedPointCloud.h"
+#include "husky_trainer/AnchorMatchability.h"
+#include "husky_trainer/CloudCompression.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/Trace.h"
+
+#define WORKING_DIRECTORY_PARAM "working_directory"
+#define ROUTE_LIBRARY_PARAM "route_library"
+#define ROUTE_NAME_PARAM "route_name"
+#define AP_TRIGGER_PARAM "ap_distance"
+#define ANGLE_AP_PARAM "ap_angle"
+#define COMPRESS_CLOUDS_PARAM "compress_clouds"
+#define COMPRESSION_RESOLUTION_PARAM "compression_resolution"
+#define LOG_SCANS_PARAM "log_scans"
+#define SCAN_LOG_QUEUE_PARAM "scan_log_queue"
+#define SCAN_LOG_RESOLUTION_PARAM "scan_log_resolution"
+#define RECORDING_THREADS_PARAM "recording_threads"
+#define RECORDING_QUEUE_PARAM "recording_queue"
+#define RECORDING_POLICY_PARAM "recording_policy"
+#define ANCHOR_SELECTION_PARAM "anchor_selection"
+#define OVERLAP_THRESHOLD_PARAM "overlap_threshold"
+#define OVERLAP_VOXEL_SIZE_PARAM "overlap_voxel_size"
+#define OVERLAP_MAX_RANGE_PARAM "overlap_max_range"
+#define CHECK_MATCHABILITY_PARAM "check_matchability"
+#define MATCHABILITY_THRESHOLD_PARAM "matchability_threshold"
+#define MATCHABILITY_ICP_CONFIG_PARAM "matchability_icp_config"
+#define MATCHABILITY_HISTORY_PARAM "matchability_history"
+#define MATCHABILITY_INLIER_DISTANCE_PARAM "matchability_inlier_distance"
+#define BACKPRESSURE_SPACING_PARAM "backpressure_spacing"
+#define DEFAULT_WORKING_DIRECTORY ""  // current working directory
+
+#define JOYSTICK_TOPIC "/joy_teleop/joy"
+#define POINT_CLOUD_TOPIC "/velodyne_points"
+#define POSE_ESTIMATE_TOPIC "/odometry/filtered"
+#define VEL_TOPIC "/joy_teleop/cmd_vel"
+#define CLOUD_RECORDER_TOPIC "/teach_repeat/anchor_points"
+#define COMPRESSED_CLOUD_RECORDER_TOPIC "/teach_repeat/compressed_anchor_points"
+#define MATCHABILITY_TOPIC "/teach_repeat/anchor_matchability"
+#define RECORDER_STATUS_TOPIC "/teach_repeat/recorder_status"
+#define STATS_TOPIC "/teach_repeat/teach_stats"
+#define STATS_PERIOD 1.0
+#define RECORDER_STATUS_TIMEOUT 5.0  // The recorder reports every second.
+#define TRACE_FILE "teach_trace.json"
+
+#define ROBOT_FRAME "/base_footprint"
+#define LIDAR_FRAME "/velodyne"
+
+#define Y_BUTTON_INDEX 3
+
+#define DEFAULT_AP_TRIGGER 0.1  // The approx distance we want between every anchor point.
+#define DEFAULT_AP_ANGLE 0.01
+#define DEFAULT_SCAN_LOG_QUEUE 20
+#define TRAJECTORY_QUEUE 4096
+#define DEFAULT_RECORDING_THREADS 2
+#define DEFAULT_RECORDING_QUEUE 4
+#define RECORDING_POLICY_SKIP "skip"
+#define RECORDING_POLICY_WAIT "wait"
+#define ANCHOR_SELECTION_DISTANCE "distance"
+#define ANCHOR_SELECTION_OVERLAP "overlap"
+#define DEFAULT_OVERLAP_THRESHOLD 0.7
+#define DEFAULT_MATCHABILITY_THRESHOLD 0.5
+#define DEFAULT_MATCHABILITY_HISTORY 30
+#define MATCHABILITY_QUEUE 16
+#define DEFAULT_BACKPRESSURE_SPACING 2.0
+#define LOOP_RATE 100
+
+Teach::Teach(ros::NodeHandle n) :
+    anchorSelector(DEFAULT_AP_TRIGGER, DEFAULT_AP_ANGLE), anchorDistance(DEFAULT_AP_TRIGGER),
+    anchorAngle(DEFAULT_AP_ANGLE), backpressureSpacing(DEFAULT_BACKPRESSURE_SPACING), spacingFactor(1.0),
+    recorderBehind(false), matchabilityThreshold(DEFAULT_MATCHABILITY_THRESHOLD),
+    matchabilityHistory(DEFAULT_MATCHABILITY_HISTORY), skippedClouds(0), recordedClouds(0),
+    recordingMicroseconds(0), windowSkipped(0), windowRecorded(0), nextCloudIndex(0), teachingStartTime(0)
+{
+    double distanceBetweenAnchorPoints, angleBetweenAnchorPoints;
+    bool logScans;
+    int scanLogQueue;
+    double scanLogResolution;
+    int recordingThreads, recordingQueue;
+    std::string recordingPolicy, anchorSelection;
+    double overlapVoxelSize, overlapMaxRange;
+    bool checkMatchability;
+    std::string matchabilityIcpConfig;
+    int history;
+    double inlierDistance;
+
+    n.param<std::string>(WORKING_DIRECTORY_PARAM, workingDirectory, DEFAULT_WORKING_DIRECTORY);
+    n.getParam(ROUTE_LIBRARY_PARAM, routeLibraryRoot);
+    n.getParam(ROUTE_NAME_PARAM, routeName);
+    n.param<double>(AP_TRIGGER_PARAM,
+            distanceBetweenAnchorPoints,
+            DEFAULT_AP_TRIGGER);
+    n.param<double>(ANGLE_AP_PARAM, angleBetweenAnchorPoints, DEFAULT_AP_ANGLE);
+    n.param<bool>(COMPRESS_CLOUDS_PARAM, compressClouds, false);
+    n.param<double>(COMPRESSION_RESOLUTION_PARAM,
+            compressionResolution,
+            DEFAULT_COMPRESSION_RESOLUTION);
+    n.param<bool>(LOG_SCANS_PARAM, logScans, false);
+    n.param<int>(SCAN_LOG_QUEUE_PARAM, scanLogQueue, DEFAULT_SCAN_LOG_QUEUE);
+    n.param<double>(SCAN_LOG_RESOLUTION_PARAM, scanLogResolution, DEFAULT_COMPRESSION_RESOLUTION);
+    n.param<int>(RECORDING_THREADS_PARAM, recordingThreads, DEFAULT_RECORDING_THREADS);
+    n.param<int>(RECORDING_QUEUE_PARAM, recordingQueue, DEFAULT_RECORDING_QUEUE);
+    n.param<std::string>(RECORDING_POLICY_PARAM, recordingPolicy, RECORDING_POLICY_SKIP);
+
+    if(recordingPolicy != RECORDING_POLICY_SKIP && recordingPolicy != RECORDING_POLICY_WAIT)
+    {
+        ROS_WARN_STREAM("Unknown recording policy " << recordingPolicy << ", using "
+                        << RECORDING_POLICY_SKIP << ".");
+    }
+    waitForRecording = recordingPolicy == RECORDING_POLICY_WAIT;
+    n.param<std::string>(ANCHOR_SELECTION_PARAM, anchorSelection, ANCHOR_SELECTION_DISTANCE);
+    n.param<double>(OVERLAP_THRESHOLD_PARAM, overlapThreshold, DEFAULT_OVERLAP_THRESHOLD);
+    n.param<double>(OVERLAP_VOXEL_SIZE_PARAM, overlapVoxelSize, DEFAULT_OVERLAP_VOXEL_SIZE);
+    n.param<double>(OVERLAP_MAX_RANGE_PARAM, overlapMaxRange, DEFAULT_OVERLAP_MAX_RANGE);
+    n.param<bool>(CHECK_MATCHABILITY_PARAM, checkMatchability, false);
+    n.param<double>(MATCHABILITY_THRESHOLD_PARAM, matchabilityThreshold, DEFAULT_MATCHABILITY_THRESHOLD);
+    n.getParam(MATCHABILITY_ICP_CONFIG_PARAM, matchabilityIcpConfig);
+    n.param<int>(MATCHABILITY_HISTORY_PARAM, history, DEFAULT_MATCHABILITY_HISTORY);
+    n.param<double>(MATCHABILITY_INLIER_DISTANCE_PARAM, inlierDistance, DEFAULT_MATCHABILITY_INLIER_DISTANCE);
+    matchabilityHistory = std::max(history, 0);
+
+    anchorDistance = distanceBetweenAnchorPoints;
+    anchorAngle = angleBetweenAnchorPoints;
+    anchorSelector.setSpacing(anchorDistance, anchorAngle);
+    n.param<double>(BACKPRESSURE_SPACING_PARAM, backpressureSpacing, DEFAULT_BACKPRESSURE_SPACING);
+
+    // When teaching into a route library, the route gets its own directory.
+    if(!routeLibraryRoot.empty() && !routeName.empty())
+    {
+        routeLibraryRoot = boost::filesystem::absolute(routeLibraryRoot).string();
+        workingDirectory = RouteLibrary(routeLibraryRoot).routeDirectory(routeName);
+    }
+
+    // The files are opened relative to the working directory rather than
+    // after a chdir, other nodelets may share the process.
+    boost::system::error_code error;
+    if(!workingDirectory.empty() && !boost::filesystem::create_directories(workingDirectory, error) &&
+       !boost::filesystem::is_directory(workingDirectory))
+    {
+        ROS_WARN("Could not create the demanded directory. Using CWD instead.");
+        workingDirectory = DEFAULT_WORKING_DIRECTORY;
+    }
+
+    tf::TransformListener tfListener;
+    cloudRecorderTopic =
+        n.advertise<husky_trainer::NamedPointCloud>(CLOUD_RECORDER_TOPIC, 100);
+    if(compressClouds)
+    {
+        compressedCloudRecorderTopic =
+            n.advertise<husky_trainer::CompressedNamedPointCloud>(COMPRESSED_CLOUD_RECORDER_TOPIC, 100);
+    }
+
+    // The positions and commands are written from a background thread, the
+    // callbacks never wait on the disk.
+    trajectoryWriter.reset(new TrajectoryWriter(pathOf(RouteLibrary::POSITIONS_FILE),
+                                                pathOf(RouteLibrary::COMMANDS_FILE),
+                                                TRAJECTORY_QUEUE));
+    if(!trajectoryWriter->isOpen())
+    {
+        ROS_ERROR("Could not open the trajectory files, the trajectory will not be recorded.");
+    }
+
+    // Fetch and store the transformation from the lidar to the base_link, we'll need it when
+    // saving the point clouds.
+    tLidarToBaseLink  =
+            PointMatcher_ros::transformListenerToEigenMatrix<float>(tfListener, ROBOT_FRAME,
+                                                                    LIDAR_FRAME, ros::Time(0));
+
+    // Every scan of the teach goes to the scan log, so the anchor points can
+    // be selected again later on without a bag.
+    if(logScans)
+    {
+        scanLog.reset(new ScanLogWriter(workingDirectory, tLidarToBaseLink, scanLogResolution,
+                                        std::max(scanLogQueue, 1)));
+        if(!scanLog->isOpen()) scanLog.reset();
+    }
+
+    // The anchor point clouds are transformed and sent by a fixed number of
+    // threads. When they fall behind, the recording policy decides whether
+    // new anchor points are skipped or the cloud callback waits.
+    recordingPool.reset(new WorkerPool(std::max(recordingThreads, 1), std::max(recordingQueue, 1)));
+
+    if(anchorSelection == ANCHOR_SELECTION_OVERLAP)
+    {
+        overlapEstimator.reset(new OverlapEstimator(tLidarToBaseLink, overlapVoxelSize, overlapMaxRange));
+    }
+    else if(anchorSelection != ANCHOR_SELECTION_DISTANCE)
+    {
+        ROS_WARN_STREAM("Unknown anchor selection " << anchorSelection << ", using "
+                        << ANCHOR_SELECTION_DISTANCE << ".");
+    }
+
+    if(checkMatchability)
+    {
+        matchabilityTopic = n.advertise<husky_trainer::AnchorMatchability>(MATCHABILITY_TOPIC, 100);
+        matchabilityChecker.reset(new MatchabilityChecker(tLidarToBaseLink, matchabilityIcpConfig,
+                                                          inlierDistance, MATCHABILITY_QUEUE));
+    }
+
+    cloudTopic = n.subscribe(POINT_CLOUD_TOPIC, 10, &Teach::cloudCallback, this);
+    joystickTopic = n.subscribe(JOYSTICK_TOPIC, 5000, &Teach::joystickCallback, this);
+    poseTopic = n.subscribe(POSE_ESTIMATE_TOPIC, 1000, &Teach::odomCallback, this);
+    velocityTopic = n.subscribe(VEL_TOPIC, 1000, &Teach::velocityCallback, this);
+    recorderStatusTopic = n.subscribe(RECORDER_STATUS_TOPIC, 10, &Teach::recorderStatusCallback, this);
+    statsTopic = n.advertise<husky_trainer::TeachStats>(STATS_TOPIC, 10);
+    statsTimer = n.createTimer(ros::Duration(STATS_PERIOD), &Teach::statsCallback, this);
+}
+
+Teach::~Teach()
+{
+    cloudTopic.shutdown();
+    joystickTopic.shutdown();
+    poseTopic.shutdown();
+    velocityTopic.shutdown();
+    recorderStatusTopic.shutdown();
+    statsTimer.stop();
+
+    overlapEstimator.reset();
+
+    // The checks of the last anchor points are done, and their results
+    // handled, before the anchor point list is saved. Handling them may
+    // insert anchor points, which are checked in turn.
+    if(matchabilityChecker)
+    {
+        matchabilityChecker->waitUntilIdle();
+        while(handleMatchabilityResults())
+        {
+            matchabilityChecker->waitUntilIdle();
+        }
+
+        if(matchabilityChecker->droppedCount() > 0)
+        {
+            ROS_WARN_STREAM("Skipped " << matchabilityChecker->droppedCount() << " matchability checks.");
+        }
+    }
+    matchabilityChecker.reset();
+
+    // Let the queued clouds go out before saving the anchor point list.
+    recordingPool.reset();
+
+    if(recordedClouds > 0)
+    {
+        ROS_INFO_STREAM("Recorded " << recordedClouds << " clouds in "
+                        << static_cast<double>(recordingMicroseconds) / recordedClouds / 1000.0
+                        << " ms on average, skipped " << skippedClouds << ".");
+    }
+
+    if(scanLog)
+    {
+        ROS_INFO_STREAM("Logged " << scanLog->loggedCount() << " scans, dropped "
+                        << scanLog->droppedCount() << ".");
+        scanLog.reset();
+    }
+
+    if(trajectoryWriter->droppedCount() > 0)
+    {
+        ROS_WARN_STREAM("Dropped " << trajectoryWriter->droppedCount() << " trajectory records.");
+    }
+    trajectoryWriter.reset();
+    saveAnchorPointList();
+
+    ROS_INFO_STREAM("Recorded " << anchorPointList.size() << " anchor points.");
+
+    if(!routeLibraryRoot.empty() && !routeName.empty())
+    {
+        RouteLibrary library(routeLibraryRoot);
+        library.loadIndex();
+        if(library.indexRoute(routeName) && library.saveIndex())
+        {
+            ROS_INFO_STREAM("Added route " << routeName << " to the library index.");
+        }
+    }
+
+    TRACE_DUMP(pathOf(TRACE_FILE));
+}
+
+void Teach::spin()
+{
+    ros::Rate loop_rate(LOOP_RATE);
+    while(ros::ok())
+    {
+        ros::spinOnce();
+        loop_rate.sleep();
+    }
+}
+
+std::string Teach::pathOf(const std::string& filename) const
+{
+    return RouteLibrary::joinPath(workingDirectory, filename);
+}
+
+void Teach::saveAnchorPointList()
+{
+    std::ofstream anchorPointListFile;
+    anchorPointListFile.open(pathOf(RouteLibrary::ANCHOR_POINTS_FILE).c_str());
+
+    for(std::map<ros::Time, AnchorPoint>::iterator it = anchorPointList.begin();
+        it != anchorPointList.end(); ++it)
+    {
+        anchorPointListFile << it->second;
+    }
+
+    anchorPointListFile.close();
+}
+
+// Runs on the recording pool. The cloud is published as a shared pointer, so
+// a cloud recorder in the same nodelet manager gets it without a copy.
+void Teach::recordCloud(const sensor_msgs::PointCloud2ConstPtr& msg, const std::string& name)
+{
+    TRACE_SPAN("Teach::recordCloud");
+    boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+
+    PM::DataPoints dataPoints;
+    dataPoints = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(*msg);
+
+    pointmatching_tools::applyTransform(dataPoints, tLidarToBaseLink);
+
+    husky_trainer::NamedPointCloudPtr namedCloud(new husky_trainer::NamedPointCloud);
+    namedCloud->cloud =
+        PointMatcher_ros::pointMatcherCloudToRosMsg<float>(
+            dataPoints,
+            ROBOT_FRAME,
+            ros::Time::now()
+        );
+    namedCloud->name = name;
+
+    if(compressClouds)
+    {
+        husky_trainer::CompressedNamedPointCloudPtr compressedCloud(
+                new husky_trainer::CompressedNamedPointCloud);
+        if(cloud_compression::compress(namedCloud->name, namedCloud->cloud,
+                                       compressionResolution, *compressedCloud))
+        {
+            compressedCloudRecorderTopic.publish(compressedCloud);
+        }
+        else
+        {
+            ROS_ERROR("Could not compress the cloud, sending it uncompressed.");
+            cloudRecorderTopic.publish(namedCloud);
+        }
+    }
+    else
+    {
+        cloudRecorderTopic.publish(namedCloud);
+    }
+    ROS_INFO("Recorded a new cloud.");
+
+    uint64_t microseconds =
+        (boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds();
+    recordedClouds++;
+    recordingMicroseconds += microseconds;
+    windowRecorded++;
+    recordingLatency.record(microseconds);
+}
+
+// An anchor point inserted between two others is named after the last
+// numbered one before it and its offset in milliseconds from it, so that the
+// names sort in the order of the path: 00003.vtk, 00003_000250.vtk, 00004.vtk.
+std::string Teach::insertedAnchorName(const ros::Time& stamp) const
+{
+    // The first anchor point is always a numbered one.
+    std::map<ros::Time, AnchorPoint>::const_iterator previous = anchorPointList.lower_bound(stamp);
+    do {
+        --previous;
+    } while(previous->second.name().find('_') != std::string::npos);
+
+    const std::string& previousName = previous->second.name();
+    std::stringstream ss;
+    ss.fill('0');
+    ss << previousName.substr(0, previousName.find('.')) << "_"
+       << std::setw(6) << (stamp - previous->first).toNSec() / 1000000 << ".vtk";
+    return ss.str();
+}
+
+// Hands the cloud to the recording pool and adds the anchor point. Returns
+// false if the anchor point was skipped because recording is behind.
+bool Teach::addAnchorPoint(const sensor_msgs::PointCloud2ConstPtr& msg, const geometry_msgs::Pose& pose,
+                           bool inserted, std::string& name)
+{
+    TRACE_SPAN("Teach::addAnchorPoint");
+    // Create the name of the point cloud.
+    if(inserted)
+    {
+        name = insertedAnchorName(msg->header.stamp);
+    }
+    else
+    {
+        std::stringstream ss;
+        ss.fill('0');
+        ss << std::setw(5) << nextCloudIndex << ".vtk";
+        name = ss.str();
+    }
+
+    WorkerPool::Job job = boost::bind(&Teach::recordCloud, this, msg, name);
+    if(waitForRecording)
+    {
+        recordingPool->post(job);
+    }
+    else if(!recordingPool->tryPost(job))
+    {
+        skippedClouds++;
+        windowSkipped++;
+        ROS_WARN_THROTTLE(1.0, "Cloud recording is falling behind, skipped %u clouds so far.",
+                          skippedClouds);
+        return false;
+    }
+
+    ROS_DEBUG("Saving a new anchor point");
+
+    if(!inserted) nextCloudIndex++;
+    anchorPointList.insert(std::make_pair(msg->header.stamp, AnchorPoint(name, pose)));
+
+    return true;
+}
+
+// Adds the anchor point that follows the last one along the path.
+bool Teach::recordAnchorPoint(const sensor_msgs::PointCloud2ConstPtr& msg, const geometry_msgs::Pose& pose)
+{
+    MatchabilityChecker::Scan scan;
+    if(!addAnchorPoint(msg, pose, false, scan.name)) return false;
+
+    anchorSelector.setLastAnchor(pose);
+
+    if(matchabilityChecker)
+    {
+        scan.cloud = msg;
+        scan.pose = pose;
+        if(lastAnchorScan.cloud) matchabilityChecker->submit(lastAnchorScan, scan);
+        lastAnchorScan = scan;
+    }
+
+    return true;
+}
+
+// Publishes the checks that are done. When two anchor points do not match
+// well enough, the recent scan closest to the middle of them becomes an
+// anchor point too, and is checked against both. This goes on until the
+// anchor points match or there is no scan left between them. Returns true if
+// an anchor point was inserted.
+bool Teach::handleMatchabilityResults()
+{
+    TRACE_SPAN("Teach::handleMatchabilityResults");
+    bool insertedAny = false;
+    MatchabilityChecker::Result result;
+    while(matchabilityChecker->takeResult(result))
+    {
+        husky_trainer::AnchorMatchability report;
+        report.header.stamp = result.reading.cloud->header.stamp;
+        report.header.frame_id = ROBOT_FRAME;
+        report.reference = result.reference.name;
+        report.reading = result.reading.name;
+        report.overlap = result.overlap;
+        report.residual = result.residual;
+        report.inserted_anchor = false;
+
+        if(result.overlap < matchabilityThreshold)
+        {
+            ros::Time first = result.reference.cloud->header.stamp;
+            ros::Time last = result.reading.cloud->header.stamp;
+            ros::Time middle = first + (last - first) * 0.5;
+
+            std::deque<MatchabilityChecker::Scan>::const_iterator closest = recentScans.end();
+            for(std::deque<MatchabilityChecker::Scan>::const_iterator it = recentScans.begin();
+                it != recentScans.end(); ++it)
+            {
+                ros::Time stamp = it->cloud->header.stamp;
+                if(stamp <= first || stamp >= last) continue;
+
+                if(closest == recentScans.end() ||
+                   fabs((stamp - middle).toSec()) < fabs((closest->cloud->header.stamp - middle).toSec()))
+                {
+                    closest = it;
+                }
+            }
+
+            if(closest == recentScans.end())
+            {
+                ROS_WARN_STREAM("Anchor points " << result.reference.name << " and " << result.reading.name
+                                << " overlap by " << result.overlap
+                                << " and there is no scan left to put between them.");
+            }
+            else
+            {
+                MatchabilityChecker::Scan inserted = *closest;
+                if(addAnchorPoint(inserted.cloud, inserted.pose, true, inserted.name))
+                {
+                    ROS_INFO_STREAM("Inserted anchor point " << inserted.name << " between "
+                                    << result.reference.name << " and " << result.reading.name << ".");
+                    report.inserted_anchor = true;
+                    insertedAny = true;
+                    matchabilityChecker->submit(result.reference, inserted);
+                    matchabilityChecker->submit(inserted, result.reading);
+                }
+            }
+        }
+
+        matchabilityTopic.publish(report);
+    }
+
+    return insertedAny;
+}
+
+void Teach::cloudCallback(const sensor_msgs::PointCloud2ConstPtr& msg)
+{
+    TRACE_SPAN("Teach::cloudCallback");
+    // A recorder that stopped reporting does not hold the teach back for good.
+    if(recorderBehind && ros::Time::now() - lastRecorderStatus > ros::Duration(RECORDER_STATUS_TIMEOUT))
+    {
+        ROS_WARN("No status from the cloud recorder in %.1f s, back to the normal anchor point spacing.",
+                 RECORDER_STATUS_TIMEOUT);
+        setRecorderBehind(false);
+    }
+
+    double distance_since_ap = anchorSelector.distanceSinceAnchor(lastOdomPosition);
+    double angle_since_ap = anchorSelector.angleSinceAnchor(lastOdomPosition);
+
+    ROS_INFO("Travel: %f", distance_since_ap);
+    ROS_INFO("Angle diff: %f", angle_since_ap);
+    ROS_INFO("Angle trigger: %f", anchorSelector.angle());
+
+    if(teachingStartTime != ros::Time(0))
+    {
+        if(scanLog)
+        {
+            scanLog->log(msg, lastOdomPosition);
+        }
+
+        ros::Time startTime = ros::Time::now();
+
+        if(matchabilityChecker)
+        {
+            handleMatchabilityResults();
+
+            MatchabilityChecker::Scan scan;
+            scan.cloud = msg;
+            scan.pose = lastOdomPosition;
+            recentScans.push_back(scan);
+            while(recentScans.size() > matchabilityHistory) recentScans.pop_front();
+        }
+
+        if(overlapEstimator)
+        {
+            // The first anchor point is taken right away. After that, a scan
+            // becomes an anchor point once the estimator finds that it does
+            // not overlap enough with the last anchor point. A skipped anchor
+            // point keeps the old reference, so a later scan can replace it.
+            OverlapEstimator::Result result;
+            if(!overlapEstimator->hasReference())
+            {
+                if(recordAnchorPoint(msg, lastOdomPosition))
+                {
+                    overlapEstimator->setReference(msg, lastOdomPosition);
+                }
+            }
+            else if(overlapEstimator->takeResult(result) && result.overlap < overlapThreshold / spacingFactor)
+            {
+                ROS_DEBUG("Overlap with the last anchor point: %f", result.overlap);
+                if(recordAnchorPoint(result.scan, result.pose))
+                {
+                    overlapEstimator->setReference(result.scan, result.pose);
+                }
+            }
+            else
+            {
+                overlapEstimator->submit(msg, lastOdomPosition);
+            }
+        }
+        // Check if we traveled enough to get a new cloud.
+        else if(anchorSelector.isNewAnchor(lastOdomPosition))
+        {
+            recordAnchorPoint(msg, lastOdomPosition);
+        }
+        else
+        {
+            ROS_DEBUG("Got a cloud too close to the last anchor point. Ignored it.");
+        }
+
+        ROS_DEBUG("The cloud callback took: %lf", (ros::Time::now() - startTime).toSec());
+    }
+}
+
+void Teach::joystickCallback(const sensor_msgs::Joy::ConstPtr& joy)
+{
+    if(joy->buttons[Y_BUTTON_INDEX] == 1 && teachingStartTime == ros::Time(0))
+    {
+        ROS_INFO("Starting Teaching.");
+        teachingStartTime = ros::Time::now();
+
+        // The positions are stamped relative to this time, keep it so that
+        // the teach can be lined up with other recordings later on.
+        std::ofstream startTimeFile(pathOf(RouteLibrary::START_TIME_FILE).c_str());
+        startTimeFile << std::fixed << teachingStartTime.toSec() << std::endl;
+    }
+}
+
+void Teach::odomCallback(const nav_msgs::Odometry::ConstPtr& msg)
+{
+    // Update the list of poses.
+    lastOdomPosition = msg->pose.pose;
+
+    if(teachingStartTime != ros::Time(0))
+    {
+        trajectoryWriter->recordPosition((ros::Time::now() - teachingStartTime).toSec(),
+                                         lastOdomPosition);
+    }
+}
+
+void Teach::velocityCallback(const geometry_msgs::Twist::ConstPtr& msg)
+{
+    if(teachingStartTime != ros::Time(0))
+    {
+        trajectoryWriter->recordCommand((ros::Time::now() - teachingStartTime).toSec(),
+                                        msg->linear.x, msg->angular.z);
+    }
+}
+
+// Fewer anchor points and no raw scans while the recorder catches up, rather
+// than anchor points lost on the way.
+void Teach::recorderStatusCallback(const husky_trainer::RecorderStatus::ConstPtr& msg)
+{
+    lastRecorderStatus = ros::Time::now();
+    if(msg->backpressure == recorderBehind) return;
+
+    setRecorderBehind(msg->backpressure);
+
+    if(recorderBehind)
+    {
+        ROS_WARN_STREAM("The cloud recorder is behind (" << msg->queue_depth << " clouds queued), spacing the "
+                        << "anchor points " << spacingFactor << " times more.");
+    }
+    else
+    {
+        ROS_INFO("The cloud recorder caught up, back to the normal anchor point spacing.");
+    }
+}
+
+void Teach::setRecorderBehind(bool behind)
+{
+    recorderBehind = behind;
+    spacingFactor = recorderBehind ? std::max(backpressureSpacing, 1.0) : 1.0;
+    anchorSelector.setSpacing(anchorDistance * spacingFactor, anchorAngle * spacingFactor);
+    if(scanLog) scanLog->setPaused(recorderBehind);
+}
+
+void Teach::statsCallback(const ros::TimerEvent& event)
+{
+    husky_trainer::TeachStats stats;
+    stats.header.stamp = event.current_real;
+    stats.window = STATS_PERIOD;
+    stats.recorded = windowRecorded.exchange(0);
+    stats.skipped = windowSkipped;
+    stats.recording = recordingLatency.summary();
+    statsTopic.publish(stats);
+
+    windowSkipped = 0;
+    recordingLatency.reset();
+}
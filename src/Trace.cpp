@@ -0,0 +1,142 @@
+
+#include "husky_trainer/Trace.h"
+
+#ifdef HUSKY_TRAINER_TRACING
+
+#include <cstdio>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <ros/ros.h>
+
+#define EVENTS_PER_THREAD 65536
+
+namespace trace
+{
+
+namespace
+{
+
+struct Event {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+// Only its thread writes to a buffer. An event is published by the release
+// of the count, so the dump reads complete events only.
+struct ThreadBuffer {
+    unsigned int threadId;
+    std::vector<Event> events;
+    boost::atomic<size_t> count;
+    boost::atomic<size_t> dropped;
+
+    explicit ThreadBuffer(unsigned int id) :
+        threadId(id), events(EVENTS_PER_THREAD), count(0), dropped(0)
+    { }
+};
+
+// The buffers outlive their threads, the registry owns them.
+boost::mutex registryMutex;
+std::vector<boost::shared_ptr<ThreadBuffer> > registry;
+
+void keepBuffer(ThreadBuffer*)
+{ }
+
+boost::thread_specific_ptr<ThreadBuffer> currentBuffer(keepBuffer);
+
+ThreadBuffer* bufferOfThread()
+{
+    ThreadBuffer* buffer = currentBuffer.get();
+    if(buffer == NULL)
+    {
+        boost::mutex::scoped_lock lock(registryMutex);
+        registry.push_back(boost::shared_ptr<ThreadBuffer>(new ThreadBuffer(registry.size() + 1)));
+        buffer = registry.back().get();
+        currentBuffer.reset(buffer);
+    }
+    return buffer;
+}
+
+uint64_t nowMicroseconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+}
+
+Span::Span(const char* name) :
+    mName(name), mStart(nowMicroseconds())
+{ }
+
+Span::~Span()
+{
+    uint64_t end = nowMicroseconds();
+    ThreadBuffer* buffer = bufferOfThread();
+
+    size_t index = buffer->count.load(boost::memory_order_relaxed);
+    if(index >= buffer->events.size())
+    {
+        buffer->dropped.fetch_add(1, boost::memory_order_relaxed);
+        return;
+    }
+
+    Event& event = buffer->events[index];
+    event.name = mName;
+    event.start = mStart;
+    event.duration = end - mStart;
+    buffer->count.store(index + 1, boost::memory_order_release);
+}
+
+// Complete events ("ph": "X") in the JSON object format.
+bool dump(const std::string& filename)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if(file == NULL) return false;
+
+    std::vector<boost::shared_ptr<ThreadBuffer> > buffers;
+    {
+        boost::mutex::scoped_lock lock(registryMutex);
+        buffers = registry;
+    }
+
+    int pid = getpid();
+    bool first = true;
+    fprintf(file, "{\"traceEvents\":[\n");
+    for(size_t i = 0; i < buffers.size(); i++)
+    {
+        const ThreadBuffer& buffer = *buffers[i];
+        size_t count = buffer.count.load(boost::memory_order_acquire);
+        for(size_t j = 0; j < count; j++)
+        {
+            const Event& event = buffer.events[j];
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%u}",
+                    first ? "" : ",\n", event.name,
+                    static_cast<unsigned long long>(event.start),
+                    static_cast<unsigned long long>(event.duration), pid, buffer.threadId);
+            first = false;
+        }
+
+        if(buffer.dropped > 0)
+        {
+            ROS_WARN("Trace buffer of thread %u was full, dropped %lu spans.", buffer.threadId,
+                     static_cast<unsigned long>(buffer.dropped.load()));
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    return fclose(file) == 0;
+}
+
+}
+
+#endif
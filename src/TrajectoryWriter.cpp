@@ -0,0 +1,155 @@
+
+#include <algorithm>
+#include <cstring>
+
+#include "husky_trainer/TrajectoryWriter.h"
+
+#define IDLE_WAIT_MS 5
+#define FLUSH_PERIOD_MS 1000
+#define LINE_BUFFER_SIZE 256
+#define L_SEP ","
+
+namespace
+{
+
+void appendPosition(std::string& out, double time, const double* pose)
+{
+    char line[LINE_BUFFER_SIZE];
+    int length = snprintf(line, sizeof(line), "%.17g" L_SEP "%g" L_SEP "%g" L_SEP "%g" L_SEP
+                          "%g" L_SEP "%g" L_SEP "%g" L_SEP "%g\n",
+                          time, pose[0], pose[1], pose[2], pose[3], pose[4], pose[5], pose[6]);
+    out.append(line, std::min<size_t>(length, sizeof(line) - 1));
+}
+
+void appendCommand(std::string& out, double time, const double* command)
+{
+    char line[LINE_BUFFER_SIZE];
+    int length = snprintf(line, sizeof(line), "%.17g" L_SEP "%g" L_SEP "%g\n",
+                          time, command[0], command[1]);
+    out.append(line, std::min<size_t>(length, sizeof(line) - 1));
+}
+
+void writeAll(FILE* file, std::string& buffer)
+{
+    if(!buffer.empty())
+    {
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    }
+}
+
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string& positionsFile, const std::string& commandsFile,
+                                   size_t capacity) :
+    mQueue(capacity), mStopping(false), mDropped(0)
+{
+    mPositionsFile = fopen(positionsFile.c_str(), "w");
+    mCommandsFile = fopen(commandsFile.c_str(), "w");
+
+    if(isOpen())
+    {
+        mThread = boost::thread(&TrajectoryWriter::work, this);
+    }
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    mStopping = true;
+    if(mThread.joinable()) mThread.join();
+
+    if(mPositionsFile) fclose(mPositionsFile);
+    if(mCommandsFile) fclose(mCommandsFile);
+}
+
+bool TrajectoryWriter::isOpen() const
+{
+    return mPositionsFile != NULL && mCommandsFile != NULL;
+}
+
+bool TrajectoryWriter::recordPosition(double time, const geometry_msgs::Pose& pose)
+{
+    Record record;
+    record.type = POSITION;
+    record.time = time;
+    record.values[0] = pose.position.x;
+    record.values[1] = pose.position.y;
+    record.values[2] = pose.position.z;
+    record.values[3] = pose.orientation.x;
+    record.values[4] = pose.orientation.y;
+    record.values[5] = pose.orientation.z;
+    record.values[6] = pose.orientation.w;
+
+    return push(record);
+}
+
+bool TrajectoryWriter::recordCommand(double time, double linear, double angular)
+{
+    Record record;
+    record.type = COMMAND;
+    record.time = time;
+    record.values[0] = linear;
+    record.values[1] = angular;
+
+    return push(record);
+}
+
+uint64_t TrajectoryWriter::droppedCount() const
+{
+    return mDropped;
+}
+
+bool TrajectoryWriter::push(const Record& record)
+{
+    if(!isOpen() || !mQueue.push(record))
+    {
+        mDropped++;
+        return false;
+    }
+    return true;
+}
+
+void TrajectoryWriter::work()
+{
+    std::string positions, commands;
+    boost::posix_time::ptime lastFlush = boost::posix_time::microsec_clock::universal_time();
+
+    while(true)
+    {
+        // Read the flag before draining, so that nothing pushed before the
+        // destructor was called can be left behind.
+        bool stopping = mStopping;
+        size_t count = drain(positions, commands);
+
+        writeAll(mPositionsFile, positions);
+        writeAll(mCommandsFile, commands);
+
+        boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+        if(stopping || (now - lastFlush).total_milliseconds() > FLUSH_PERIOD_MS)
+        {
+            fflush(mPositionsFile);
+            fflush(mCommandsFile);
+            lastFlush = now;
+        }
+
+        if(stopping) return;
+
+        if(count == 0)
+        {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(IDLE_WAIT_MS));
+        }
+    }
+}
+
+size_t TrajectoryWriter::drain(std::string& positions, std::string& commands)
+{
+    size_t count = 0;
+    Record record;
+    while(mQueue.pop(record))
+    {
+        if(record.type == POSITION) appendPosition(positions, record.time, record.values);
+        else appendCommand(commands, record.time, record.values);
+        count++;
+    }
+    return count;
+}
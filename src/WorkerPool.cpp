@@ -0,0 +1,104 @@
+
+#include "husky_trainer/WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned int threadCount, size_t capacity) :
+    mCapacity(capacity > 0 ? capacity : 1), mActiveJobs(0), mStopping(false)
+{
+    if(threadCount == 0) threadCount = 1;
+
+    for(unsigned int i = 0; i < threadCount; i++)
+    {
+        mThreads.create_thread(boost::bind(&WorkerPool::work, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mStopping = true;
+    }
+    mJobAvailable.notify_all();
+    mThreads.join_all();
+}
+
+// Queue a job if there is room for it. Never blocks.
+bool WorkerPool::tryPost(const Job& job)
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        if(mJobs.size() >= mCapacity) return false;
+        mJobs.push_back(job);
+    }
+    mJobAvailable.notify_one();
+    return true;
+}
+
+// Queue a job, waiting for room in the queue if needed.
+void WorkerPool::post(const Job& job)
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        while(mJobs.size() >= mCapacity)
+        {
+            mSpaceAvailable.wait(lock);
+        }
+        mJobs.push_back(job);
+    }
+    mJobAvailable.notify_one();
+}
+
+void WorkerPool::waitUntilIdle()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    while(!mJobs.empty() || mActiveJobs > 0)
+    {
+        mIdle.wait(lock);
+    }
+}
+
+size_t WorkerPool::pendingCount()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mJobs.size() + mActiveJobs;
+}
+
+size_t WorkerPool::capacity() const
+{
+    return mCapacity;
+}
+
+unsigned int WorkerPool::threadCount() const
+{
+    return mThreads.size();
+}
+
+void WorkerPool::work()
+{
+    while(true)
+    {
+        Job job;
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            while(mJobs.empty() && !mStopping)
+            {
+                mJobAvailable.wait(lock);
+            }
+
+            if(mJobs.empty()) return;
+
+            job = mJobs.front();
+            mJobs.pop_front();
+            mActiveJobs++;
+        }
+        mSpaceAvailable.notify_one();
+
+        job();
+
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            mActiveJobs--;
+            if(mJobs.empty() && mActiveJobs == 0) mIdle.notify_all();
+        }
+    }
+}
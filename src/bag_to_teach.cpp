@@ -0,0 +1,302 @@
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/Joy.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <geometry_msgs/Twist.h>
+#include <nav_msgs/Odometry.h>
+#include <tf/tf.h>
+#include <tf/tfMessage.h>
+#include <tf_conversions/tf_eigen.h>
+
+#include "husky_trainer/AnchorPoint.h"
+#include "husky_trainer/AnchorSelector.h"
+#include "husky_trainer/CloudPreparation.h"
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/PointMatching.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/WorkerPool.h"
+
+#define DEFAULT_SCAN_TOPIC "/velodyne_points"
+#define DEFAULT_ODOM_TOPIC "/odometry/filtered"
+#define DEFAULT_JOY_TOPIC "/joy_teleop/joy"
+#define DEFAULT_VEL_TOPIC "/joy_teleop/cmd_vel"
+#define TF_TOPIC "/tf"
+#define TF_STATIC_TOPIC "/tf_static"
+
+#define ROBOT_FRAME "/base_footprint"
+#define LIDAR_FRAME "/velodyne"
+
+#define Y_BUTTON_INDEX 3
+
+#define DEFAULT_AP_TRIGGER 0.1
+#define DEFAULT_AP_ANGLE 0.01
+#define JOBS_PER_THREAD 2
+#define L_SEP ","
+
+typedef PointMatcher<float> PM;
+
+struct Options {
+    std::string bagFile;
+    std::string outputDirectory;
+    std::string scanTopic;
+    std::string odomTopic;
+    std::string joyTopic;
+    std::string velTopic;
+    double apDistance;
+    double apAngle;
+    double startTime;
+    unsigned int threadCount;
+    bool hasLidarToRobot;
+    PM::TransformationParameters tLidarToRobot;
+};
+
+void printUsage()
+{
+    std::cerr << "Usage: bag_to_teach BAG OUTPUT_DIRECTORY [options]" << std::endl <<
+        "Options:" << std::endl <<
+        "  --ap-distance D       Distance between anchor points. Default: 0.1." << std::endl <<
+        "  --ap-angle A          Angle between anchor points. Default: 0.01." << std::endl <<
+        "  --scan-topic T        Default: /velodyne_points." << std::endl <<
+        "  --odom-topic T        Default: /odometry/filtered." << std::endl <<
+        "  --joy-topic T         Default: /joy_teleop/joy." << std::endl <<
+        "  --vel-topic T         Default: /joy_teleop/cmd_vel." << std::endl <<
+        "  --threads N           Number of threads saving clouds. Default: all cores." << std::endl <<
+        "  --start-time T        Start teaching at this time instead of on the Y button." << std::endl <<
+        "  --lidar-to-robot P    Pose of the lidar in the robot frame, as x,y,z,qx,qy,qz,qw." << std::endl <<
+        "                        Default: looked up in the tf messages of the bag." << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    if(argc < 3) return false;
+
+    options.bagFile = argv[1];
+    options.outputDirectory = argv[2];
+    options.scanTopic = DEFAULT_SCAN_TOPIC;
+    options.odomTopic = DEFAULT_ODOM_TOPIC;
+    options.joyTopic = DEFAULT_JOY_TOPIC;
+    options.velTopic = DEFAULT_VEL_TOPIC;
+    options.apDistance = DEFAULT_AP_TRIGGER;
+    options.apAngle = DEFAULT_AP_ANGLE;
+    options.startTime = -1.0;
+    options.threadCount = boost::thread::hardware_concurrency();
+    options.hasLidarToRobot = false;
+    options.tLidarToRobot = PM::TransformationParameters::Identity(4, 4);
+
+    for(int i = 3; i < argc; i += 2)
+    {
+        if(i + 1 >= argc) return false;
+
+        std::string option(argv[i]);
+        std::string value(argv[i + 1]);
+
+        if(option == "--ap-distance") options.apDistance = strtod(value.c_str(), NULL);
+        else if(option == "--ap-angle") options.apAngle = strtod(value.c_str(), NULL);
+        else if(option == "--scan-topic") options.scanTopic = value;
+        else if(option == "--odom-topic") options.odomTopic = value;
+        else if(option == "--joy-topic") options.joyTopic = value;
+        else if(option == "--vel-topic") options.velTopic = value;
+        else if(option == "--threads") options.threadCount = strtoul(value.c_str(), NULL, 10);
+        else if(option == "--start-time") options.startTime = strtod(value.c_str(), NULL);
+        else if(option == "--lidar-to-robot")
+        {
+            options.tLidarToRobot = geo_util::pmTransOfPose(geo_util::stringToPose(value));
+            options.hasLidarToRobot = true;
+        }
+        else return false;
+    }
+
+    return true;
+}
+
+// Reads the tf messages of the bag until the lidar can be placed on the robot.
+bool lookupLidarToRobot(rosbag::Bag& bag, PM::TransformationParameters& out)
+{
+    std::vector<std::string> topics;
+    topics.push_back(TF_TOPIC);
+    topics.push_back(TF_STATIC_TOPIC);
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+    tf::Transformer transformer(true, ros::Duration(view.getEndTime() - view.getBeginTime()) +
+                                      ros::Duration(1.0));
+
+    BOOST_FOREACH(rosbag::MessageInstance const m, view)
+    {
+        tf::tfMessage::ConstPtr transforms = m.instantiate<tf::tfMessage>();
+        if(!transforms) continue;
+
+        for(size_t i = 0; i < transforms->transforms.size(); i++)
+        {
+            tf::StampedTransform transform;
+            tf::transformStampedMsgToTF(transforms->transforms[i], transform);
+            transformer.setTransform(transform, "bag", m.getTopic() == TF_STATIC_TOPIC);
+        }
+
+        if(transformer.canTransform(ROBOT_FRAME, LIDAR_FRAME, ros::Time(0)))
+        {
+            tf::StampedTransform lidarToRobot;
+            transformer.lookupTransform(ROBOT_FRAME, LIDAR_FRAME, ros::Time(0), lidarToRobot);
+
+            Eigen::Affine3d eigenTransform;
+            tf::transformTFToEigen(lidarToRobot, eigenTransform);
+            out = eigenTransform.matrix().cast<float>();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Plays the bag through the same logic as the teach node. Messages are read
+// in time order and every output only depends on the messages before it, so
+// the resulting teach is the same from one run to the next. Only the writing
+// of the clouds is done in parallel, each job to its own file.
+int main(int argc, char** argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    ros::Time::init();
+
+    rosbag::Bag bag;
+    try {
+        bag.open(options.bagFile, rosbag::bagmode::Read);
+    } catch(rosbag::BagException& e) {
+        std::cerr << "Could not open bag: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if(!options.hasLidarToRobot && !lookupLidarToRobot(bag, options.tLidarToRobot))
+    {
+        std::cerr << "Could not find the lidar in the tf of the bag, use --lidar-to-robot." << std::endl;
+        return 1;
+    }
+
+    boost::filesystem::create_directories(options.outputDirectory);
+
+    std::ofstream positionRecord(
+            RouteLibrary::joinPath(options.outputDirectory, RouteLibrary::POSITIONS_FILE).c_str());
+    std::ofstream speedRecord(
+            RouteLibrary::joinPath(options.outputDirectory, RouteLibrary::COMMANDS_FILE).c_str());
+
+    std::vector<std::string> topics;
+    topics.push_back(options.scanTopic);
+    topics.push_back(options.odomTopic);
+    topics.push_back(options.joyTopic);
+    topics.push_back(options.velTopic);
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+    AnchorSelector selector(options.apDistance, options.apAngle);
+    std::vector<AnchorPoint> anchorPoints;
+    geometry_msgs::Pose lastOdomPosition;
+    ros::Time teachingStartTime(0);
+
+    if(options.startTime >= 0.0) teachingStartTime = ros::Time(options.startTime);
+
+    {
+        WorkerPool pool(options.threadCount, JOBS_PER_THREAD * options.threadCount);
+
+        BOOST_FOREACH(rosbag::MessageInstance const m, view)
+        {
+            const ros::Time time = m.getTime();
+            bool teaching = teachingStartTime != ros::Time(0) && teachingStartTime <= time;
+
+            if(m.getTopic() == options.joyTopic)
+            {
+                sensor_msgs::Joy::ConstPtr joy = m.instantiate<sensor_msgs::Joy>();
+                if(joy && teachingStartTime == ros::Time(0) &&
+                   joy->buttons.size() > Y_BUTTON_INDEX && joy->buttons[Y_BUTTON_INDEX] == 1)
+                {
+                    teachingStartTime = time;
+                }
+            }
+            else if(m.getTopic() == options.odomTopic)
+            {
+                nav_msgs::Odometry::ConstPtr odom = m.instantiate<nav_msgs::Odometry>();
+                if(!odom) continue;
+
+                lastOdomPosition = odom->pose.pose;
+                if(teaching)
+                {
+                    positionRecord <<
+                        boost::lexical_cast<std::string>((time - teachingStartTime).toSec()) << L_SEP <<
+                        geo_util::poseToString(lastOdomPosition);
+                }
+            }
+            else if(m.getTopic() == options.velTopic)
+            {
+                geometry_msgs::Twist::ConstPtr twist = m.instantiate<geometry_msgs::Twist>();
+                if(!twist || !teaching) continue;
+
+                speedRecord <<
+                    boost::lexical_cast<std::string>((time - teachingStartTime).toSec()) << L_SEP <<
+                    twist->linear.x << L_SEP << twist->angular.z << "\n";
+            }
+            else if(m.getTopic() == options.scanTopic)
+            {
+                sensor_msgs::PointCloud2ConstPtr scan = m.instantiate<sensor_msgs::PointCloud2>();
+                if(!scan || !teaching || !selector.isNewAnchor(lastOdomPosition)) continue;
+
+                selector.setLastAnchor(lastOdomPosition);
+
+                std::stringstream ss;
+                ss.fill('0');
+                ss << std::setw(5) << anchorPoints.size() << ".vtk";
+                std::string name = ss.str();
+
+                std::string filename = RouteLibrary::joinPath(options.outputDirectory, name);
+
+                // A prepared cloud from an earlier teach would shadow the new one.
+                boost::filesystem::remove(CloudPreparation::preparedFileOf(filename));
+
+                anchorPoints.push_back(AnchorPoint(name, lastOdomPosition));
+                pool.post(boost::bind(pointmatching_tools::saveTransformedCloud, scan, options.tLidarToRobot,
+                                      filename));
+            }
+        }
+    }
+
+    bag.close();
+    positionRecord.close();
+    speedRecord.close();
+
+    if(teachingStartTime == ros::Time(0))
+    {
+        std::cerr << "The Y button was never pressed in the bag, use --start-time." << std::endl;
+        return 1;
+    }
+
+    std::ofstream startTimeFile(
+            RouteLibrary::joinPath(options.outputDirectory, RouteLibrary::START_TIME_FILE).c_str());
+    startTimeFile << std::fixed << teachingStartTime.toSec() << std::endl;
+
+    std::ofstream anchorPointListFile(
+            RouteLibrary::joinPath(options.outputDirectory, RouteLibrary::ANCHOR_POINTS_FILE).c_str());
+    for(size_t i = 0; i < anchorPoints.size(); i++)
+    {
+        anchorPointListFile << anchorPoints[i];
+    }
+
+    std::cout << "Converted the teach with " << anchorPoints.size() << " anchor points." << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,244 @@
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <ros/ros.h>
+
+#include "husky_trainer/LatencyHistogram.h"
+#include "husky_trainer/LatencyProbe.h"
+#include "husky_trainer/LatencyProbeEcho.h"
+
+#define NODE_NAME "latency_bench"
+
+#define PROBE_TOPIC_PARAM "probe_topic"
+#define ECHO_TOPIC_PARAM "echo_topic"
+#define LOAD_THREADS_PARAM "load_threads"
+#define LOAD_DUTY_PARAM "load_duty"
+#define REPORT_PERIOD_PARAM "report_period"
+#define OUTPUT_PARAM "output"
+
+#define DEFAULT_PROBE_TOPIC "/teach_repeat/latency_probe"
+#define DEFAULT_ECHO_TOPIC "/teach_repeat/latency_probe_echo"
+#define DEFAULT_LOAD_DUTY 1.0
+#define DEFAULT_REPORT_PERIOD 10.0
+
+#define LOAD_PERIOD_US 10000
+#define MATCH_WINDOW 1.0  // Seconds a probe waits for its echo.
+#define ECHO_HISTORY 256
+
+// The stages a scan goes through, from its stamp to the robot.
+enum Stage { RECEIVE = 0, MATCHING, CONTROLLER, PLAYBACK, REPEATER, TOTAL, STAGE_COUNT };
+
+static const char* STAGE_NAMES[STAGE_COUNT] = {
+    "receive", "matching", "controller", "playback", "repeater", "total"
+};
+
+// Follows the latency probes of the repeat to the commands sent to the robot.
+// A probe goes out with the first command corrected with the error of its
+// scan. The command repeater echoes the probe, with the same seq, when it
+// forwards that command.
+class LatencyBench {
+public:
+    LatencyBench(ros::NodeHandle& n) :
+        stopping(false), unmatchedProbes(0), lastProbeSeq(0)
+    {
+        std::string probeTopic, echoTopic;
+        int loadThreads;
+        double reportPeriod;
+
+        n.param<std::string>(PROBE_TOPIC_PARAM, probeTopic, DEFAULT_PROBE_TOPIC);
+        n.param<std::string>(ECHO_TOPIC_PARAM, echoTopic, DEFAULT_ECHO_TOPIC);
+        n.param<int>(LOAD_THREADS_PARAM, loadThreads, 0);
+        n.param<double>(LOAD_DUTY_PARAM, loadDuty, DEFAULT_LOAD_DUTY);
+        n.param<double>(REPORT_PERIOD_PARAM, reportPeriod, DEFAULT_REPORT_PERIOD);
+        n.param<std::string>(OUTPUT_PARAM, outputFile, "");
+
+        for(int i = 0; i < loadThreads; i++)
+        {
+            loadGroup.create_thread(boost::bind(&LatencyBench::load, this));
+        }
+        ROS_INFO("Measuring with %d load threads busy %.0f%% of the time.", loadThreads, 100.0 * loadDuty);
+
+        probeTopicSub = n.subscribe(probeTopic, 100, &LatencyBench::probeCallback, this);
+        echoTopicSub = n.subscribe(echoTopic, 1000, &LatencyBench::echoCallback, this);
+        reportTimer = n.createTimer(ros::Duration(reportPeriod), &LatencyBench::reportCallback, this);
+    }
+
+    ~LatencyBench()
+    {
+        stopping = true;
+        loadGroup.join_all();
+
+        ROS_INFO("Over the whole run:");
+        report(overall);
+
+        if(!outputFile.empty()) writeSummary();
+    }
+
+private:
+    std::deque<husky_trainer::LatencyProbe> probes;
+    std::deque<husky_trainer::LatencyProbeEcho> echoes;
+    LatencyHistogram window[STAGE_COUNT];
+    LatencyHistogram overall[STAGE_COUNT];
+    double loadDuty;
+    std::string outputFile;
+    boost::atomic<bool> stopping;
+    boost::thread_group loadGroup;
+    unsigned int unmatchedProbes;
+    uint32_t lastProbeSeq;
+
+    ros::Subscriber probeTopicSub;
+    ros::Subscriber echoTopicSub;
+    ros::Timer reportTimer;
+
+    // Busy for the duty cycle of every period, asleep the rest of it.
+    void load()
+    {
+        uint64_t busy = static_cast<uint64_t>(loadDuty * LOAD_PERIOD_US);
+        volatile double sink = 0.0;
+
+        while(!stopping)
+        {
+            uint64_t start = LatencyHistogram::monotonicMicroseconds();
+            while(LatencyHistogram::monotonicMicroseconds() - start < busy)
+            {
+                for(int i = 0; i < 1000; i++) sink = sink + i * 0.5;
+            }
+            if(busy < LOAD_PERIOD_US)
+            {
+                boost::this_thread::sleep(boost::posix_time::microseconds(LOAD_PERIOD_US - busy));
+            }
+        }
+    }
+
+    void probeCallback(const husky_trainer::LatencyProbe::ConstPtr& msg)
+    {
+        // The repeat started over, the echoes kept are of its last run.
+        if(msg->seq < lastProbeSeq) echoes.clear();
+        lastProbeSeq = msg->seq;
+
+        probes.push_back(*msg);
+        match();
+    }
+
+    void echoCallback(const husky_trainer::LatencyProbeEcho::ConstPtr& msg)
+    {
+        echoes.push_back(*msg);
+        if(echoes.size() > ECHO_HISTORY) echoes.pop_front();
+
+        match();
+    }
+
+    // An echo left over from an earlier run of the repeat may have the same
+    // seq, but its command was received before the probe was published.
+    static bool isEchoOf(const husky_trainer::LatencyProbeEcho& echo, const husky_trainer::LatencyProbe& probe)
+    {
+        return echo.seq == probe.seq && echo.command_received >= probe.command_published;
+    }
+
+    void match()
+    {
+        ros::Time now = ros::Time::now();
+        std::deque<husky_trainer::LatencyProbe>::iterator probe = probes.begin();
+        while(probe != probes.end())
+        {
+            bool matched = false;
+            for(size_t i = 0; i < echoes.size() && !matched; i++)
+            {
+                if(isEchoOf(echoes[i], *probe))
+                {
+                    record(*probe, echoes[i].command_forwarded);
+                    matched = true;
+                }
+            }
+
+            if(matched)
+            {
+                probe = probes.erase(probe);
+            }
+            else if(now - probe->command_published > ros::Duration(MATCH_WINDOW))
+            {
+                unmatchedProbes++;
+                probe = probes.erase(probe);
+            }
+            else
+            {
+                ++probe;
+            }
+        }
+    }
+
+    void record(const husky_trainer::LatencyProbe& probe, const ros::Time& atRobot)
+    {
+        ros::Duration stages[STAGE_COUNT];
+        stages[RECEIVE] = probe.received - probe.scan_stamp;
+        stages[MATCHING] = probe.matched - probe.received;
+        stages[CONTROLLER] = probe.corrected - probe.matched;
+        stages[PLAYBACK] = probe.command_published - probe.corrected;
+        stages[REPEATER] = atRobot - probe.command_published;
+        stages[TOTAL] = atRobot - probe.scan_stamp;
+
+        for(int i = 0; i < STAGE_COUNT; i++)
+        {
+            uint64_t microseconds = stages[i] > ros::Duration(0) ? stages[i].toNSec() / 1000 : 0;
+            window[i].record(microseconds);
+            overall[i].record(microseconds);
+        }
+    }
+
+    void reportCallback(const ros::TimerEvent& event)
+    {
+        report(window);
+        for(int i = 0; i < STAGE_COUNT; i++) window[i].reset();
+    }
+
+    void report(const LatencyHistogram* histograms) const
+    {
+        ROS_INFO("%-10s %8s %8s %8s %8s %8s %8s", "Stage", "Count", "Mean ms", "p50 ms", "p90 ms", "p99 ms",
+                 "Max ms");
+        for(int i = 0; i < STAGE_COUNT; i++)
+        {
+            husky_trainer::LatencySummary summary = histograms[i].summary();
+            ROS_INFO("%-10s %8lu %8.2f %8.2f %8.2f %8.2f %8.2f", STAGE_NAMES[i],
+                     static_cast<unsigned long>(summary.count), summary.mean_ms, summary.p50_ms,
+                     summary.p90_ms, summary.p99_ms, summary.max_ms);
+        }
+        if(unmatchedProbes > 0)
+        {
+            ROS_WARN("%u probes were never echoed by the command repeater.", unmatchedProbes);
+        }
+    }
+
+    void writeSummary() const
+    {
+        std::ofstream file(outputFile.c_str());
+        file << "stage,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n";
+        for(int i = 0; i < STAGE_COUNT; i++)
+        {
+            husky_trainer::LatencySummary summary = overall[i].summary();
+            file << STAGE_NAMES[i] << "," << summary.count << "," << summary.mean_ms << "," <<
+                summary.p50_ms << "," << summary.p90_ms << "," << summary.p99_ms << "," <<
+                summary.max_ms << "\n";
+        }
+    }
+};
+
+// Reports the time from the stamp of a scan to the command it corrected
+// reaching the robot, stage by stage, while threads load the CPU. The repeat
+// must run with latency_probes set.
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, NODE_NAME);
+    ros::NodeHandle n("~");
+
+    LatencyBench bench(n);
+    ros::spin();
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "husky_trainer/CloudRecorder.h"
+#include "husky_trainer/CommandRepeater.h"
+#include "husky_trainer/Repeat.h"
+#include "husky_trainer/Teach.h"
+
+// Nodelet wrappers of the nodes, so they can share a manager with the
+// velodyne driver and receive the clouds without serialization. The private
+// node handle runs the callbacks of a nodelet one at a time, like spinOnce
+// does for the standalone nodes.
+namespace husky_trainer
+{
+
+class TeachNodelet : public nodelet::Nodelet {
+private:
+    boost::shared_ptr<Teach> teach;
+
+    virtual void onInit()
+    {
+        teach.reset(new Teach(getPrivateNodeHandle()));
+    }
+};
+
+// Loading the teach and waiting for tf takes seconds, it is done on a thread
+// of its own rather than holding up the manager in onInit.
+class RepeatNodelet : public nodelet::Nodelet {
+public:
+    ~RepeatNodelet()
+    {
+        loader.join();
+    }
+
+private:
+    boost::shared_ptr<Repeat> repeat;
+    boost::thread loader;
+
+    virtual void onInit()
+    {
+        repeat.reset(new Repeat(getPrivateNodeHandle()));
+        loader = boost::thread(&RepeatNodelet::load, this);
+    }
+
+    void load()
+    {
+        if(repeat->load(getPrivateNodeHandle()))
+        {
+            repeat->startPlaybackTimer(getPrivateNodeHandle());
+        }
+        else
+        {
+            NODELET_ERROR("The repeat could not start.");
+        }
+    }
+};
+
+class CloudRecorderNodelet : public nodelet::Nodelet {
+private:
+    boost::shared_ptr<CloudRecorder> recorder;
+
+    virtual void onInit()
+    {
+        recorder.reset(new CloudRecorder(getPrivateNodeHandle()));
+    }
+};
+
+class CommandRepeaterNodelet : public nodelet::Nodelet {
+private:
+    boost::shared_ptr<CommandRepeater> repeater;
+
+    virtual void onInit()
+    {
+        repeater.reset(new CommandRepeater(getPrivateNodeHandle()));
+    }
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(husky_trainer::TeachNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(husky_trainer::RepeatNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(husky_trainer::CloudRecorderNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(husky_trainer::CommandRepeaterNodelet, nodelet::Nodelet)
@@ -0,0 +1,306 @@
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "husky_trainer/AnchorPoint.h"
+#include "husky_trainer/AnchorSelector.h"
+#include "husky_trainer/CloudPreparation.h"
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/PointMatching.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/ScanLog.h"
+#include "husky_trainer/WorkerPool.h"
+
+#define DEFAULT_SCAN_TOPIC "/velodyne_points"
+#define DEFAULT_AP_TRIGGER 0.1
+#define DEFAULT_AP_ANGLE 0.01
+#define JOBS_PER_THREAD 2
+
+typedef PointMatcher<float> PM;
+
+struct Options {
+    std::string source;
+    std::string teachDirectory;
+    std::string outputDirectory;
+    std::string scanTopic;
+    double apDistance;
+    double apAngle;
+    double startTime;
+    unsigned int threadCount;
+    PM::TransformationParameters tLidarToRobot;
+};
+
+void printUsage()
+{
+    std::cerr << "Usage: reanchor SOURCE TEACH_DIRECTORY OUTPUT_DIRECTORY [options]" << std::endl <<
+        "SOURCE is a bag of the scans, or a directory holding a scan log." << std::endl <<
+        "Options:" << std::endl <<
+        "  --ap-distance D       Distance between anchor points. Default: 0.1." << std::endl <<
+        "  --ap-angle A          Angle between anchor points. Default: 0.01." << std::endl <<
+        "  --topic T             Topic of the scans in the bag. Default: /velodyne_points." << std::endl <<
+        "  --threads N           Number of threads saving clouds. Default: all cores." << std::endl <<
+        "  --start-time T        Time the teach started at, if there is no teach.start file." << std::endl <<
+        "  --lidar-to-robot P    Pose of the lidar in the robot frame, as x,y,z,qx,qy,qz,qw." << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    if(argc < 4) return false;
+
+    options.source = argv[1];
+    options.teachDirectory = argv[2];
+    options.outputDirectory = argv[3];
+    options.scanTopic = DEFAULT_SCAN_TOPIC;
+    options.apDistance = DEFAULT_AP_TRIGGER;
+    options.apAngle = DEFAULT_AP_ANGLE;
+    options.startTime = -1.0;
+    options.threadCount = boost::thread::hardware_concurrency();
+    options.tLidarToRobot = PM::TransformationParameters::Identity(4, 4);
+
+    for(int i = 4; i < argc; i += 2)
+    {
+        if(i + 1 >= argc) return false;
+
+        std::string option(argv[i]);
+        std::string value(argv[i + 1]);
+
+        if(option == "--ap-distance") options.apDistance = strtod(value.c_str(), NULL);
+        else if(option == "--ap-angle") options.apAngle = strtod(value.c_str(), NULL);
+        else if(option == "--topic") options.scanTopic = value;
+        else if(option == "--threads") options.threadCount = strtoul(value.c_str(), NULL, 10);
+        else if(option == "--start-time") options.startTime = strtod(value.c_str(), NULL);
+        else if(option == "--lidar-to-robot")
+        {
+            options.tLidarToRobot = geo_util::pmTransOfPose(geo_util::stringToPose(value));
+        }
+        else return false;
+    }
+
+    return true;
+}
+
+bool loadPositions(const std::string& filename, std::vector<geometry_msgs::PoseStamped>& out)
+{
+    std::ifstream positionFile(filename.c_str());
+    if(!positionFile.is_open()) return false;
+
+    std::string lineBuffer;
+    while(std::getline(positionFile, lineBuffer))
+    {
+        out.push_back(geo_util::stampedPoseOfString(lineBuffer));
+    }
+
+    return !out.empty();
+}
+
+// Pose of the robot at a time relative to the start of the teach, false if
+// the time is outside of the recorded positions.
+bool poseOfTime(const std::vector<geometry_msgs::PoseStamped>& positions,
+                std::vector<geometry_msgs::PoseStamped>::const_iterator& cursor,
+                ros::Time time, geometry_msgs::Pose& out)
+{
+    if(time < positions.front().header.stamp || positions.back().header.stamp < time)
+    {
+        return false;
+    }
+
+    while(cursor + 1 != positions.end() && (cursor + 1)->header.stamp < time)
+    {
+        cursor++;
+    }
+
+    out = cursor + 1 == positions.end() ? cursor->pose :
+        geo_util::linInterpolation(*cursor, *(cursor + 1), time);
+
+    return true;
+}
+
+// Keeps the scan as an anchor point if the robot moved enough since the last
+// one. The cloud is transformed and written by the pool.
+void considerScan(const sensor_msgs::PointCloud2ConstPtr& scan, const geometry_msgs::Pose& pose,
+                  const Options& options, AnchorSelector& selector, WorkerPool& pool,
+                  std::vector<AnchorPoint>& anchorPoints)
+{
+    if(!selector.isNewAnchor(pose)) return;
+    selector.setLastAnchor(pose);
+
+    std::stringstream ss;
+    ss.fill('0');
+    ss << std::setw(5) << anchorPoints.size() << ".vtk";
+    std::string name = ss.str();
+
+    std::string filename = RouteLibrary::joinPath(options.outputDirectory, name);
+
+    // A prepared cloud left by the teach would shadow the new one.
+    boost::filesystem::remove(CloudPreparation::preparedFileOf(filename));
+
+    anchorPoints.push_back(AnchorPoint(name, pose));
+    pool.post(boost::bind(pointmatching_tools::saveTransformedCloud, scan, options.tLidarToRobot,
+                          filename));
+}
+
+bool selectFromBag(const Options& options, AnchorSelector& selector, WorkerPool& pool,
+                   std::vector<AnchorPoint>& anchorPoints)
+{
+    std::vector<geometry_msgs::PoseStamped> positions;
+    if(!loadPositions(RouteLibrary::joinPath(options.teachDirectory, RouteLibrary::POSITIONS_FILE), positions))
+    {
+        std::cerr << "Could not read the positions of the teach." << std::endl;
+        return false;
+    }
+
+    double startTime = options.startTime;
+    if(startTime < 0.0)
+    {
+        std::ifstream startTimeFile(
+                RouteLibrary::joinPath(options.teachDirectory, RouteLibrary::START_TIME_FILE).c_str());
+        if(!(startTimeFile >> startTime))
+        {
+            std::cerr << "Could not read the start time of the teach, use --start-time." << std::endl;
+            return false;
+        }
+    }
+
+    rosbag::Bag bag;
+    try {
+        bag.open(options.source, rosbag::bagmode::Read);
+    } catch(rosbag::BagException& e) {
+        std::cerr << "Could not open bag: " << e.what() << std::endl;
+        return false;
+    }
+
+    rosbag::View view(bag, rosbag::TopicQuery(options.scanTopic));
+    std::vector<geometry_msgs::PoseStamped>::const_iterator cursor = positions.begin();
+
+    BOOST_FOREACH(rosbag::MessageInstance const m, view)
+    {
+        sensor_msgs::PointCloud2ConstPtr scan = m.instantiate<sensor_msgs::PointCloud2>();
+        if(!scan) continue;
+
+        double relativeTime = m.getTime().toSec() - startTime;
+        geometry_msgs::Pose pose;
+        if(relativeTime < 0.0 || !poseOfTime(positions, cursor, ros::Time(relativeTime), pose))
+        {
+            continue;
+        }
+
+        considerScan(scan, pose, options, selector, pool, anchorPoints);
+    }
+
+    bag.close();
+    return true;
+}
+
+// The scan log already holds the pose of every scan and the lidar to robot
+// transform, only the selected scans are decompressed.
+bool selectFromScanLog(Options& options, AnchorSelector& selector, WorkerPool& pool,
+                       std::vector<AnchorPoint>& anchorPoints)
+{
+    ScanLogReader log;
+    if(!log.open(options.source))
+    {
+        std::cerr << "Could not read the scan log in " << options.source << "." << std::endl;
+        return false;
+    }
+
+    options.tLidarToRobot = log.lidarToRobot();
+
+    for(size_t i = 0; i < log.size(); i++)
+    {
+        geometry_msgs::Pose pose;
+        if(!log.readPose(i, pose) || !selector.isNewAnchor(pose)) continue;
+
+        sensor_msgs::PointCloud2Ptr scan(new sensor_msgs::PointCloud2);
+        if(!log.readScan(i, *scan, pose))
+        {
+            std::cerr << "Could not read scan " << i << " of the scan log." << std::endl;
+            continue;
+        }
+
+        considerScan(scan, pose, options, selector, pool, anchorPoints);
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    ros::Time::init();
+
+    boost::filesystem::create_directories(options.outputDirectory);
+
+    AnchorSelector selector(options.apDistance, options.apAngle);
+    std::vector<AnchorPoint> anchorPoints;
+    bool selected;
+
+    // Selecting anchor points is sequential and cheap, transforming and
+    // writing the clouds is spread on the pool. The bounded queue keeps only a
+    // few scans in memory at any time.
+    {
+        WorkerPool pool(options.threadCount, JOBS_PER_THREAD * options.threadCount);
+
+        if(boost::filesystem::is_directory(options.source))
+        {
+            selected = selectFromScanLog(options, selector, pool, anchorPoints);
+        }
+        else
+        {
+            selected = selectFromBag(options, selector, pool, anchorPoints);
+        }
+    }
+
+    if(!selected) return 1;
+
+    std::ofstream anchorPointListFile(
+            RouteLibrary::joinPath(options.outputDirectory, RouteLibrary::ANCHOR_POINTS_FILE).c_str());
+    for(size_t i = 0; i < anchorPoints.size(); i++)
+    {
+        anchorPointListFile << anchorPoints[i];
+    }
+    anchorPointListFile.close();
+
+    // The trajectory does not change, carry it over so that the output is a
+    // complete teach.
+    const std::string teachFiles[] = {RouteLibrary::POSITIONS_FILE, RouteLibrary::COMMANDS_FILE,
+                                      RouteLibrary::START_TIME_FILE};
+    bool sameDirectory = boost::filesystem::equivalent(
+            options.teachDirectory.empty() ? "." : options.teachDirectory,
+            options.outputDirectory.empty() ? "." : options.outputDirectory);
+
+    for(int i = 0; i < 3 && !sameDirectory; i++)
+    {
+        boost::filesystem::path source(RouteLibrary::joinPath(options.teachDirectory, teachFiles[i]));
+        boost::filesystem::path destination(RouteLibrary::joinPath(options.outputDirectory, teachFiles[i]));
+
+        if(boost::filesystem::exists(source))
+        {
+            boost::filesystem::copy_file(source, destination,
+                                         boost::filesystem::copy_option::overwrite_if_exists);
+        }
+    }
+
+    std::cout << "Selected " << anchorPoints.size() << " anchor points." << std::endl;
+
+    return 0;
+}
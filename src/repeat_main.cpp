@@ -10,6 +10,7 @@ int main(int argc, char**argv)
     ros::NodeHandle n("~");
 
     Repeat repeat(n);
+    if(!repeat.load(n)) return 1;
     repeat.spin();
 
     return 0;
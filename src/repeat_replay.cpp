@@ -0,0 +1,313 @@
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/Joy.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "pointmatcher_ros/point_cloud.h"
+
+#include "husky_trainer/ControllerMappings.h"
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/Repeat.h"
+#include "husky_trainer/RepeatClock.h"
+#include "husky_trainer/RepeatIO.h"
+
+#define DEFAULT_SCAN_TOPIC "/velodyne_points"
+#define DEFAULT_JOY_TOPIC "/joy_teleop/joy"
+#define DEFAULT_SEED 1
+#define L_SEP ","
+
+#define COMMANDS_OUTPUT "commands.csv"
+#define REFERENCE_POSES_OUTPUT "reference_poses.csv"
+#define RAW_ERRORS_OUTPUT "raw_errors.csv"
+#define CORRECTED_ERRORS_OUTPUT "corrected_errors.csv"
+#define AP_SWITCHES_OUTPUT "ap_switches.csv"
+
+typedef PointMatcher<float> PM;
+
+struct Options {
+    std::string bagFile;
+    std::string teachDirectory;
+    std::string outputDirectory;
+    std::string scanTopic;
+    std::string joyTopic;
+    std::string icpConfig;
+    unsigned int seed;
+    bool autostart;
+    geometry_msgs::Pose lidarToRobot;
+};
+
+// Follows the stamps of the recorded messages.
+class ReplayClock : public RepeatClock {
+public:
+    ReplayClock() : time(0) { }
+    virtual ros::Time now() const { return time; }
+    void set(const ros::Time& newTime) { time = newTime; }
+
+private:
+    ros::Time time;
+};
+
+// Writes every output to a file, stamped with the replay clock, and matches
+// the clouds in process like the match_clouds service does. The prepared
+// anchor points are matched without the reference filters.
+class ReplayIO : public RepeatIO {
+public:
+    ReplayIO(const std::string& outputDirectory, const ReplayClock& clock, PM::ICP& icp, PM::ICP& preparedIcp) :
+        clock(clock), icp(icp), preparedIcp(preparedIcp), matches(0), failedMatches(0)
+    {
+        open(commands, outputDirectory, COMMANDS_OUTPUT);
+        open(referencePoses, outputDirectory, REFERENCE_POSES_OUTPUT);
+        open(rawErrors, outputDirectory, RAW_ERRORS_OUTPUT);
+        open(correctedErrors, outputDirectory, CORRECTED_ERRORS_OUTPUT);
+        open(anchorPointSwitches, outputDirectory, AP_SWITCHES_OUTPUT);
+    }
+
+    virtual void publishCommand(const geometry_msgs::Twist& command)
+    {
+        stamp(commands) << command.linear.x << L_SEP << command.angular.z << "\n";
+    }
+
+    virtual void publishReferencePose(const geometry_msgs::Pose& pose)
+    {
+        stamp(referencePoses) << geo_util::poseToString(pose);
+    }
+
+    virtual void publishRawError(const husky_trainer::TrajectoryError& error)
+    {
+        writeError(rawErrors, error);
+    }
+
+    virtual void publishCorrectedError(const husky_trainer::TrajectoryError& error)
+    {
+        writeError(correctedErrors, error);
+    }
+
+    virtual void publishAnchorPointSwitch(const husky_trainer::AnchorPointSwitch& msg)
+    {
+        stamp(anchorPointSwitches) << msg.newAnchorPoint << "\n";
+    }
+
+    virtual void publishStats(const husky_trainer::RepeatStats& stats)
+    { }
+
+    // In bag time, the latencies of a replay mean nothing.
+    virtual void publishLatencyProbe(const husky_trainer::LatencyProbe& probe)
+    { }
+
+    virtual bool matchClouds(pointmatcher_ros::MatchClouds& match, bool preparedReference)
+    {
+        PM::DataPoints reading = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(match.request.readings);
+        PM::DataPoints reference = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(match.request.reference);
+
+        PM::TransformationParameters transform;
+        try {
+            transform = preparedReference ? preparedIcp(reading, reference) : icp(reading, reference);
+        } catch(PM::ConvergenceError& e) {
+            failedMatches++;
+            return false;
+        }
+
+        Eigen::Affine3d eigenTransform(transform.cast<double>());
+        tf::Transform tfTransform;
+        tf::transformEigenToTF(eigenTransform, tfTransform);
+        tf::transformTFToMsg(tfTransform, match.response.transform);
+
+        matches++;
+        return true;
+    }
+
+    unsigned int matchCount() const { return matches; }
+    unsigned int failedMatchCount() const { return failedMatches; }
+
+private:
+    const ReplayClock& clock;
+    PM::ICP& icp;
+    PM::ICP& preparedIcp;
+    unsigned int matches;
+    unsigned int failedMatches;
+    std::ofstream commands;
+    std::ofstream referencePoses;
+    std::ofstream rawErrors;
+    std::ofstream correctedErrors;
+    std::ofstream anchorPointSwitches;
+
+    static void open(std::ofstream& file, const std::string& directory, const std::string& name)
+    {
+        file.open(RouteLibrary::joinPath(directory, name).c_str());
+        file << std::fixed << std::setprecision(9);
+    }
+
+    std::ofstream& stamp(std::ofstream& file)
+    {
+        file << clock.now().toSec() << L_SEP;
+        return file;
+    }
+
+    void writeError(std::ofstream& file, const husky_trainer::TrajectoryError& error)
+    {
+        stamp(file) << error.x << L_SEP << error.y << L_SEP << error.theta << "\n";
+    }
+};
+
+void printUsage()
+{
+    std::cerr << "Usage: repeat_replay BAG TEACH_DIRECTORY OUTPUT_DIRECTORY [options]" << std::endl <<
+        "Options:" << std::endl <<
+        "  --icp-config F        ICP configuration. Default: the default ICP of libpointmatcher." << std::endl <<
+        "  --scan-topic T        Default: /velodyne_points." << std::endl <<
+        "  --joy-topic T         Default: /joy_teleop/joy." << std::endl <<
+        "  --lidar-to-robot P    Pose of the lidar in the robot frame, as x,y,z,qx,qy,qz,qw." << std::endl <<
+        "                        Default: identity." << std::endl <<
+        "  --autostart 1         Play forward from the first message, without the joystick." << std::endl <<
+        "  --seed N              Seed of the random filters of the ICP. Default: 1." << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    if(argc < 4) return false;
+
+    options.bagFile = argv[1];
+    options.teachDirectory = argv[2];
+    options.outputDirectory = argv[3];
+    options.scanTopic = DEFAULT_SCAN_TOPIC;
+    options.joyTopic = DEFAULT_JOY_TOPIC;
+    options.seed = DEFAULT_SEED;
+    options.autostart = false;
+    options.lidarToRobot = geo_util::stringToPose("0,0,0,0,0,0,1");
+
+    for(int i = 4; i < argc; i += 2)
+    {
+        if(i + 1 >= argc) return false;
+
+        std::string option(argv[i]);
+        std::string value(argv[i + 1]);
+
+        if(option == "--icp-config") options.icpConfig = value;
+        else if(option == "--scan-topic") options.scanTopic = value;
+        else if(option == "--joy-topic") options.joyTopic = value;
+        else if(option == "--lidar-to-robot") options.lidarToRobot = geo_util::stringToPose(value);
+        else if(option == "--autostart") options.autostart = value == "1";
+        else if(option == "--seed") options.seed = strtoul(value.c_str(), NULL, 10);
+        else return false;
+    }
+
+    return true;
+}
+
+// Plays the readings and joystick messages of a bag into the repeat as fast
+// as they can be processed. The clock jumps from one message to the next,
+// with the playback ticks in between at the rate of the node. The matching
+// is done in the same thread, so every run gives the same outputs.
+int main(int argc, char** argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    ros::Time::init();
+    srand(options.seed);
+
+    PM::ICP icp, preparedIcp;
+    if(options.icpConfig.empty())
+    {
+        icp.setDefault();
+        preparedIcp.setDefault();
+    }
+    else
+    {
+        std::ifstream config(options.icpConfig.c_str());
+        std::ifstream preparedConfig(options.icpConfig.c_str());
+        if(!config.good() || !preparedConfig.good())
+        {
+            std::cerr << "Could not open " << options.icpConfig << "." << std::endl;
+            return 1;
+        }
+        icp.loadFromYaml(config);
+        preparedIcp.loadFromYaml(preparedConfig);
+    }
+    preparedIcp.referenceDataPointsFilters.clear();
+
+    rosbag::Bag bag;
+    try {
+        bag.open(options.bagFile, rosbag::bagmode::Read);
+    } catch(rosbag::BagException& e) {
+        std::cerr << "Could not open bag: " << e.what() << std::endl;
+        return 1;
+    }
+
+    boost::filesystem::create_directories(options.outputDirectory);
+
+    std::vector<std::string> topics;
+    topics.push_back(options.scanTopic);
+    topics.push_back(options.joyTopic);
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+    tf::Transform lidarToRobot;
+    tf::poseMsgToTF(options.lidarToRobot, lidarToRobot);
+
+    ReplayClock clock;
+    ReplayIO io(options.outputDirectory, clock, icp, preparedIcp);
+    Repeat repeat(options.teachDirectory, lidarToRobot, husky_trainer::RepeatConfig::__getDefault__(), clock, io);
+
+    const ros::Duration tickPeriod(1.0 / Repeat::LOOP_RATE);
+    ros::Time nextTick = view.getBeginTime();
+    unsigned int readings = 0;
+
+    if(options.autostart)
+    {
+        clock.set(nextTick);
+
+        sensor_msgs::Joy::Ptr start(new sensor_msgs::Joy());
+        start->buttons.resize(controller_mappings::START + 1, 0);
+        start->buttons[controller_mappings::RB] = 1;
+        repeat.joystickCallback(start);
+    }
+
+    BOOST_FOREACH(rosbag::MessageInstance const m, view)
+    {
+        const ros::Time time = m.getTime();
+        while(nextTick <= time)
+        {
+            clock.set(nextTick);
+            repeat.tick();
+            nextTick += tickPeriod;
+        }
+        clock.set(time);
+
+        if(m.getTopic() == options.scanTopic)
+        {
+            sensor_msgs::PointCloud2ConstPtr scan = m.instantiate<sensor_msgs::PointCloud2>();
+            if(!scan) continue;
+
+            repeat.cloudCallback(scan);
+            readings++;
+        }
+        else if(m.getTopic() == options.joyTopic && !options.autostart)
+        {
+            sensor_msgs::Joy::ConstPtr joy = m.instantiate<sensor_msgs::Joy>();
+            if(joy) repeat.joystickCallback(joy);
+        }
+    }
+
+    bag.close();
+
+    std::cout << "Replayed " << readings << " readings, " << io.matchCount() << " matched, "
+              << io.failedMatchCount() << " failed to match." << std::endl;
+
+    return 0;
+}
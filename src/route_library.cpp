@@ -0,0 +1,102 @@
+
+#include <cstdlib>
+#include <iostream>
+
+#include <ros/ros.h>
+#include <geometry_msgs/Pose.h>
+
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/RouteGraph.h"
+
+void printUsage()
+{
+    std::cerr << "Usage: route_library LIBRARY index" << std::endl <<
+        "       route_library LIBRARY add ROUTE" << std::endl <<
+        "       route_library LIBRARY remove ROUTE" << std::endl <<
+        "       route_library LIBRARY list" << std::endl <<
+        "       route_library LIBRARY near X Y RADIUS" << std::endl <<
+        "       route_library LIBRARY graph RADIUS" << std::endl <<
+        "       route_library LIBRARY plan ROUTE ANCHOR GOAL_ROUTE GOAL_ANCHOR" << std::endl;
+}
+
+void printRoutes(const std::vector<RouteEntry>& routes)
+{
+    for(size_t i = 0; i < routes.size(); i++)
+    {
+        std::cout << routes[i];
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        printUsage();
+        return 1;
+    }
+
+    RouteLibrary library(argv[1]);
+    std::string command(argv[2]);
+
+    if(command == "index")
+    {
+        int routeCount = library.rebuildIndex();
+        std::cout << "Indexed " << routeCount << " routes." << std::endl;
+        return library.saveIndex() ? 0 : 1;
+    }
+
+    library.loadIndex();
+
+    if(command == "add" && argc == 4)
+    {
+        if(!library.indexRoute(argv[3])) return 1;
+        return library.saveIndex() ? 0 : 1;
+    }
+    else if(command == "remove" && argc == 4)
+    {
+        library.removeRoute(argv[3]);
+        return library.saveIndex() ? 0 : 1;
+    }
+    else if(command == "list")
+    {
+        printRoutes(library.routes());
+        return 0;
+    }
+    else if(command == "near" && argc == 6)
+    {
+        geometry_msgs::Pose pose;
+        pose.position.x = strtod(argv[3], NULL);
+        pose.position.y = strtod(argv[4], NULL);
+        printRoutes(library.routesNear(pose, strtod(argv[5], NULL)));
+        return 0;
+    }
+    else if(command == "graph" && argc == 4)
+    {
+        RouteGraph graph;
+        graph.loadRoutes(library);
+        int junctionCount = graph.detectJunctions(strtod(argv[3], NULL));
+        std::cout << "Found " << junctionCount << " junctions." << std::endl;
+        return graph.save(RouteLibrary::joinPath(library.root(), RouteGraph::GRAPH_FILE)) ? 0 : 1;
+    }
+    else if(command == "plan" && argc == 7)
+    {
+        RouteGraph graph;
+        std::vector<RouteLeg> legs;
+        graph.loadRoutes(library);
+        if(!graph.load(RouteLibrary::joinPath(library.root(), RouteGraph::GRAPH_FILE)) ||
+           !graph.plan(argv[3], strtol(argv[4], NULL, 10), argv[5], strtol(argv[6], NULL, 10), legs))
+        {
+            std::cerr << "No path found." << std::endl;
+            return 1;
+        }
+
+        for(size_t i = 0; i < legs.size(); i++)
+        {
+            std::cout << legs[i].route << "," << legs[i].firstAnchor << "," << legs[i].lastAnchor << std::endl;
+        }
+        return 0;
+    }
+
+    printUsage();
+    return 1;
+}
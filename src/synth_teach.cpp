@@ -0,0 +1,108 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <boost/thread.hpp>
+
+#include "husky_trainer/CloudIO.h"
+#include "husky_trainer/SyntheticRoute.h"
+
+#define DEFAULT_SEED 42
+
+struct Options {
+    std::string outputDirectory;
+    size_t anchorCount;
+    double apDistance;
+    double speed;
+    size_t pointCount;
+    double range;
+    std::string templateFile;
+    double tileLength;
+    unsigned int seed;
+    unsigned int threadCount;
+};
+
+void printUsage()
+{
+    std::cerr << "Usage: synth_teach OUTPUT_DIRECTORY ANCHOR_COUNT [options]" << std::endl <<
+        "Options:" << std::endl <<
+        "  --ap-distance D       Distance between anchor points. Default: 0.5." << std::endl <<
+        "  --speed V             Speed of the robot. Default: 0.5." << std::endl <<
+        "  --points N            Points per cloud. Default: 5000." << std::endl <<
+        "  --range R             Range of the scans of the pillars. Default: 20." << std::endl <<
+        "  --template F          Binary PCD tiled along the path instead of the pillars." << std::endl <<
+        "  --tile-length L       Distance between the copies of the template. Default: 10." << std::endl <<
+        "  --seed N              Default: 42." << std::endl <<
+        "  --threads N           Number of threads writing clouds. Default: all cores." << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    if(argc < 3) return false;
+
+    options.outputDirectory = argv[1];
+    options.anchorCount = strtoul(argv[2], NULL, 10);
+    options.apDistance = DEFAULT_SYNTHETIC_AP_DISTANCE;
+    options.speed = DEFAULT_SYNTHETIC_SPEED;
+    options.pointCount = DEFAULT_SYNTHETIC_POINTS;
+    options.range = DEFAULT_SYNTHETIC_RANGE;
+    options.tileLength = DEFAULT_SYNTHETIC_TILE_LENGTH;
+    options.seed = DEFAULT_SEED;
+    options.threadCount = boost::thread::hardware_concurrency();
+
+    for(int i = 3; i < argc; i += 2)
+    {
+        if(i + 1 >= argc) return false;
+
+        std::string option(argv[i]);
+        std::string value(argv[i + 1]);
+
+        if(option == "--ap-distance") options.apDistance = strtod(value.c_str(), NULL);
+        else if(option == "--speed") options.speed = strtod(value.c_str(), NULL);
+        else if(option == "--points") options.pointCount = strtoul(value.c_str(), NULL, 10);
+        else if(option == "--range") options.range = strtod(value.c_str(), NULL);
+        else if(option == "--template") options.templateFile = value;
+        else if(option == "--tile-length") options.tileLength = strtod(value.c_str(), NULL);
+        else if(option == "--seed") options.seed = strtoul(value.c_str(), NULL, 10);
+        else if(option == "--threads") options.threadCount = strtoul(value.c_str(), NULL, 10);
+        else return false;
+    }
+
+    return options.anchorCount > 0;
+}
+
+// Writes a teach of the given number of anchor points, to test the repeat on
+// routes longer than anyone would drive.
+int main(int argc, char** argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    SyntheticRoute route(options.seed, options.apDistance, options.speed);
+    route.setPointCount(options.pointCount);
+    route.setRange(options.range);
+
+    if(!options.templateFile.empty())
+    {
+        sensor_msgs::PointCloud2 cloud;
+        if(!cloud_io::readPcd(options.templateFile, cloud) || !route.setTemplate(cloud, options.tileLength))
+        {
+            std::cerr << "Could not read " << options.templateFile << ", a binary PCD file is needed." << std::endl;
+            return 1;
+        }
+    }
+
+    if(!route.write(options.outputDirectory, options.anchorCount, options.threadCount))
+    {
+        std::cerr << "Could not write the teach to " << options.outputDirectory << "." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << options.anchorCount << " anchor points." << std::endl;
+
+    return 0;
+}
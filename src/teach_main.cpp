@@ -0,0 +1,16 @@
+
+#include <ros/ros.h>
+#include "husky_trainer/Teach.h"
+
+#define NODE_NAME "husky_teach"
+
+int main(int argc, char**argv)
+{
+    ros::init(argc,argv, NODE_NAME);
+    ros::NodeHandle n("~");
+
+    Teach teach(n);
+    teach.spin();
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <time.h>
+
+#include <boost/function.hpp>
+
+// A small harness for the benchmarks of the package. A case runs its body
+// the number of times it is given. The count is doubled until a batch takes
+// the minimum time, then a few batches are timed and the median time per
+// iteration is reported.
+//
+//   ./husky_trainer_bench [--filter SUBSTRING] [--min-time SECONDS]
+//                         [--repetitions N] [--csv]
+class Benchmark {
+public:
+    typedef boost::function<void (size_t iterations)> Case;
+
+    Benchmark(int argc, char** argv) :
+        minTime(0.2), repetitions(5), csv(false), valid(true)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            std::string option(argv[i]);
+            if(option == "--csv") csv = true;
+            else if(i + 1 < argc && option == "--filter") filter = argv[++i];
+            else if(i + 1 < argc && option == "--min-time") minTime = strtod(argv[++i], NULL);
+            else if(i + 1 < argc && option == "--repetitions") repetitions = strtoul(argv[++i], NULL, 10);
+            else valid = false;
+        }
+        if(repetitions == 0) valid = false;
+    }
+
+    void add(const std::string& name, Case benchmarkCase)
+    {
+        if(filter.empty() || name.find(filter) != std::string::npos)
+        {
+            names.push_back(name);
+            cases.push_back(benchmarkCase);
+        }
+    }
+
+    int run()
+    {
+        if(!valid)
+        {
+            fprintf(stderr, "Options: --filter SUBSTRING, --min-time SECONDS, --repetitions N, --csv\n");
+            return 1;
+        }
+
+        if(csv) printf("name,iterations,median_ns,min_ns,max_ns\n");
+        else printf("%-48s %12s %12s %12s %12s\n", "Benchmark", "Iterations", "Median ns", "Min ns", "Max ns");
+
+        for(size_t i = 0; i < cases.size(); i++)
+        {
+            size_t iterations = 1;
+            while(timeOf(cases[i], iterations) < minTime * 1e9 && iterations < (size_t(1) << 40))
+            {
+                iterations *= 2;
+            }
+
+            std::vector<double> perIteration;
+            for(unsigned int j = 0; j < repetitions; j++)
+            {
+                perIteration.push_back(static_cast<double>(timeOf(cases[i], iterations)) / iterations);
+            }
+            std::sort(perIteration.begin(), perIteration.end());
+
+            double median = perIteration[perIteration.size() / 2];
+            if(csv)
+            {
+                printf("%s,%lu,%.1f,%.1f,%.1f\n", names[i].c_str(), static_cast<unsigned long>(iterations),
+                       median, perIteration.front(), perIteration.back());
+            }
+            else
+            {
+                printf("%-48s %12lu %12.1f %12.1f %12.1f\n", names[i].c_str(),
+                       static_cast<unsigned long>(iterations), median, perIteration.front(),
+                       perIteration.back());
+            }
+            fflush(stdout);
+        }
+
+        return 0;
+    }
+
+    // Keeps the compiler from optimizing away a result that is not used.
+    template<typename T>
+    static void keep(const T& value)
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    static uint64_t nowNanoseconds()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+private:
+    std::vector<std::string> names;
+    std::vector<Case> cases;
+    std::string filter;
+    double minTime;
+    unsigned int repetitions;
+    bool csv;
+    bool valid;
+
+    static uint64_t timeOf(const Case& benchmarkCase, size_t iterations)
+    {
+        uint64_t start = nowNanoseconds();
+        benchmarkCase(iterations);
+        return nowNanoseconds() - start;
+    }
+};
+
+#endif
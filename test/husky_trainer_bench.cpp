@@ -0,0 +1,239 @@
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include <geometry_msgs/PoseStamped.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/PointMatching.h"
+#include "husky_trainer/CloudCompression.h"
+
+#include "Benchmark.h"
+
+// The inputs are drawn from a fixed seed, so every run times the same work.
+#define SEED 42
+#define INPUT_COUNT 1024
+#define SMALL_CLOUD 1000
+#define SAMPLE_CLOUD 88000  // About the size of test/sample.pcd.
+
+typedef PointMatcher<float> PM;
+typedef PM::DataPoints DP;
+typedef boost::variate_generator<boost::mt19937&, boost::uniform_real<> > Uniform;
+
+struct Inputs {
+    std::vector<geometry_msgs::Pose> poses;
+    std::vector<geometry_msgs::PoseStamped> stampedPoses;
+    std::vector<geometry_msgs::Quaternion> quaternions;
+    std::vector<Eigen::Quaternionf> eigenQuaternions;
+    std::vector<std::string> positionLines;
+    std::vector<std::string> commandLines;
+    PM::TransformationParameters transform;
+    PM::TransformationParameters inverse;
+};
+
+geometry_msgs::Pose randomPose(Uniform& position, Uniform& angle)
+{
+    geometry_msgs::Pose pose;
+    pose.position.x = position();
+    pose.position.y = position();
+    pose.position.z = 0.01 * position();
+    pose.orientation = tf::createQuaternionMsgFromYaw(angle());
+    return pose;
+}
+
+void makeInputs(Inputs& inputs)
+{
+    boost::mt19937 generator(SEED);
+    Uniform position(generator, boost::uniform_real<>(-50.0, 50.0));
+    Uniform angle(generator, boost::uniform_real<>(-M_PI, M_PI));
+    Uniform speed(generator, boost::uniform_real<>(-1.0, 1.0));
+
+    for(int i = 0; i < INPUT_COUNT; i++)
+    {
+        geometry_msgs::PoseStamped stamped;
+        stamped.header.stamp = ros::Time(0.1 * i);
+        stamped.pose = randomPose(position, angle);
+
+        inputs.poses.push_back(stamped.pose);
+        inputs.stampedPoses.push_back(stamped);
+        inputs.quaternions.push_back(stamped.pose.orientation);
+        inputs.eigenQuaternions.push_back(geo_util::rosQuatToEigenQuat(stamped.pose.orientation));
+
+        // The formats of positions.pl and speeds.sl.
+        std::ostringstream positionLine;
+        positionLine << 0.1 * i << "," << geo_util::poseToString(stamped.pose);
+        inputs.positionLines.push_back(positionLine.str());
+
+        std::ostringstream commandLine;
+        commandLine << 0.1 * i << "," << speed() << "," << speed() << "\n";
+        inputs.commandLines.push_back(commandLine.str());
+    }
+
+    inputs.transform = geo_util::pmTransOfPose(randomPose(position, angle));
+    inputs.inverse = inputs.transform.inverse();
+}
+
+// A cylinder of points around the robot, a bit like a lidar scan.
+sensor_msgs::PointCloud2 makeCloud(size_t pointCount)
+{
+    boost::mt19937 generator(SEED);
+    Uniform angle(generator, boost::uniform_real<>(-M_PI, M_PI));
+    Uniform range(generator, boost::uniform_real<>(2.0, 30.0));
+    Uniform height(generator, boost::uniform_real<>(-1.0, 3.0));
+
+    std::vector<float> xyz;
+    for(size_t i = 0; i < pointCount; i++)
+    {
+        double theta = angle();
+        double r = range();
+        xyz.push_back(r * cos(theta));
+        xyz.push_back(r * sin(theta));
+        xyz.push_back(height());
+    }
+
+    std_msgs::Header header;
+    header.frame_id = "/velodyne";
+    return cloud_compression::cloudOfPoints(xyz, header);
+}
+
+void benchCustomDistance(const Inputs& inputs, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(geo_util::customDistance(inputs.poses[i % INPUT_COUNT],
+                                                 inputs.poses[(i + 1) % INPUT_COUNT]));
+    }
+}
+
+void benchQuatTo2dYaw(const Inputs& inputs, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(geo_util::quatTo2dYaw(inputs.quaternions[i % INPUT_COUNT]));
+    }
+}
+
+void benchEigenQuatTo2dYaw(const Inputs& inputs, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(geo_util::quatTo2dYaw(inputs.eigenQuaternions[i % INPUT_COUNT]));
+    }
+}
+
+void benchEigenTransformOfPoses(const Inputs& inputs, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(geo_util::eigenTransformOfPoses(inputs.poses[i % INPUT_COUNT],
+                                                        inputs.poses[(i + 1) % INPUT_COUNT]));
+    }
+}
+
+void benchTransFromPoseToPose(const Inputs& inputs, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(geo_util::transFromPoseToPose(inputs.poses[i % INPUT_COUNT],
+                                                      inputs.poses[(i + 1) % INPUT_COUNT]));
+    }
+}
+
+void benchStampedPoseOfString(const Inputs& inputs, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(geo_util::stampedPoseOfString(inputs.positionLines[i % INPUT_COUNT]));
+    }
+}
+
+void benchStampedTwistOfString(const Inputs& inputs, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(geo_util::stampedTwistOfString(inputs.commandLines[i % INPUT_COUNT]));
+    }
+}
+
+void benchLinInterpolation(size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(geo_util::linInterpolation(0.0, i, 1.0, 2.0 * i, 0.25));
+    }
+}
+
+// The way Repeat::poseOfTime uses it, halfway between two positions.
+void benchPoseInterpolation(const Inputs& inputs, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        const geometry_msgs::PoseStamped& lhs = inputs.stampedPoses[i % (INPUT_COUNT - 1)];
+        const geometry_msgs::PoseStamped& rhs = inputs.stampedPoses[i % (INPUT_COUNT - 1) + 1];
+        ros::Time middle = lhs.header.stamp + (rhs.header.stamp - lhs.header.stamp) * 0.5;
+        Benchmark::keep(geo_util::linInterpolation(lhs, rhs, middle));
+    }
+}
+
+// Goes back and forth between the transform and its inverse, so the cloud
+// stays put from one batch to the next.
+void benchApplyTransform(const Inputs& inputs, DP& cloud, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        pointmatching_tools::applyTransform(cloud, i % 2 == 0 ? inputs.transform : inputs.inverse);
+        Benchmark::keep(cloud.features);
+    }
+}
+
+void benchApplyTransformMsg(const Inputs& inputs, const sensor_msgs::PointCloud2& cloud, size_t iterations)
+{
+    for(size_t i = 0; i < iterations; i++)
+    {
+        Benchmark::keep(pointmatching_tools::applyTransform(cloud, inputs.transform));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    ros::Time::init();
+
+    Inputs inputs;
+    makeInputs(inputs);
+
+    sensor_msgs::PointCloud2 smallMsg = makeCloud(SMALL_CLOUD);
+    sensor_msgs::PointCloud2 sampleMsg = makeCloud(SAMPLE_CLOUD);
+    DP smallCloud = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(smallMsg);
+    DP sampleCloud = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(sampleMsg);
+
+    Benchmark benchmark(argc, argv);
+    benchmark.add("geo_util::customDistance", boost::bind(benchCustomDistance, boost::cref(inputs), _1));
+    benchmark.add("geo_util::quatTo2dYaw/msg", boost::bind(benchQuatTo2dYaw, boost::cref(inputs), _1));
+    benchmark.add("geo_util::quatTo2dYaw/eigen", boost::bind(benchEigenQuatTo2dYaw, boost::cref(inputs), _1));
+    benchmark.add("geo_util::eigenTransformOfPoses",
+                  boost::bind(benchEigenTransformOfPoses, boost::cref(inputs), _1));
+    benchmark.add("geo_util::transFromPoseToPose",
+                  boost::bind(benchTransFromPoseToPose, boost::cref(inputs), _1));
+    benchmark.add("geo_util::stampedPoseOfString",
+                  boost::bind(benchStampedPoseOfString, boost::cref(inputs), _1));
+    benchmark.add("geo_util::stampedTwistOfString",
+                  boost::bind(benchStampedTwistOfString, boost::cref(inputs), _1));
+    benchmark.add("geo_util::linInterpolation/scalar", benchLinInterpolation);
+    benchmark.add("geo_util::linInterpolation/pose",
+                  boost::bind(benchPoseInterpolation, boost::cref(inputs), _1));
+    benchmark.add("pointmatching_tools::applyTransform/1k",
+                  boost::bind(benchApplyTransform, boost::cref(inputs), boost::ref(smallCloud), _1));
+    benchmark.add("pointmatching_tools::applyTransform/88k",
+                  boost::bind(benchApplyTransform, boost::cref(inputs), boost::ref(sampleCloud), _1));
+    benchmark.add("pointmatching_tools::applyTransform/msg_88k",
+                  boost::bind(benchApplyTransformMsg, boost::cref(inputs), boost::cref(sampleMsg), _1));
+
+    return benchmark.run();
+}
@@ -1,9 +1,25 @@
 // Bring in my package's API, which is what I'm testing
 #include "husky_trainer/PointMatching.h"
+#include "husky_trainer/AnchorPoint.h"
 #include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/CloudCompression.h"
+#include "husky_trainer/CloudIO.h"
+#include "husky_trainer/CloudPreparation.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/RouteGraph.h"
+#include "husky_trainer/ScanLog.h"
+#include "husky_trainer/TrajectoryWriter.h"
+#include "husky_trainer/OverlapEstimator.h"
+#include "husky_trainer/LatencyHistogram.h"
+#include "husky_trainer/Controller.h"
+#include "husky_trainer/SyntheticRoute.h"
 // Bring in gtest
 #include <gtest/gtest.h>
 
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
 #include <pointmatcher/PointMatcher.h>
 #include <Eigen/Geometry>
 
@@ -17,6 +33,395 @@ TEST(GeoUtil, quatTo2dYaw)
     std::cout << yaw1 << std::endl << yaw2 << std::endl;
 }
 
+TEST(CloudCompression, roundTrip)
+{
+    std::vector<float> xyz;
+    for(int i = 0; i < 1000; i++)
+    {
+        xyz.push_back(10.0 * cos(0.01 * i));
+        xyz.push_back(10.0 * sin(0.01 * i));
+        xyz.push_back(-0.5 + 0.001 * i);
+    }
+
+    std_msgs::Header header;
+    header.frame_id = "/base_footprint";
+    sensor_msgs::PointCloud2 cloud = cloud_compression::cloudOfPoints(xyz, header);
+
+    husky_trainer::CompressedNamedPointCloud compressed;
+    ASSERT_TRUE(cloud_compression::compress("00000.vtk", cloud, 0.001, compressed));
+    EXPECT_EQ(1000u, compressed.point_count);
+    EXPECT_LT(compressed.data.size(), cloud.data.size());
+
+    sensor_msgs::PointCloud2 decompressed;
+    ASSERT_TRUE(cloud_compression::decompress(compressed, decompressed));
+    EXPECT_EQ(header.frame_id, decompressed.header.frame_id);
+
+    std::vector<float> decodedXyz;
+    ASSERT_TRUE(cloud_compression::extractPoints(decompressed, decodedXyz));
+    ASSERT_EQ(xyz.size(), decodedXyz.size());
+    for(size_t i = 0; i < xyz.size(); i++)
+    {
+        EXPECT_NEAR(xyz[i], decodedXyz[i], 0.0005 + 1e-6);
+    }
+
+    // A header that promises more points than the buffer holds.
+    cloud.width += 1;
+    EXPECT_FALSE(cloud_compression::extractPoints(cloud, decodedXyz));
+}
+
+TEST(CloudIO, pcdRoundTrip)
+{
+    std::vector<float> xyz;
+    for(int i = 0; i < 1000; i++)
+    {
+        xyz.push_back(0.01 * i);
+        xyz.push_back(-0.02 * i);
+        xyz.push_back(1.0);
+    }
+
+    std_msgs::Header header;
+    sensor_msgs::PointCloud2 cloud = cloud_compression::cloudOfPoints(xyz, header);
+
+    std::string filename =
+        (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    ASSERT_TRUE(cloud_io::writePcd(filename, cloud, true));
+    ASSERT_TRUE(cloud_io::isPcd(filename));
+
+    sensor_msgs::PointCloud2 loaded;
+    ASSERT_TRUE(cloud_io::readPcd(filename, loaded));
+    EXPECT_EQ(cloud.point_step, loaded.point_step);
+    EXPECT_EQ(cloud.fields.size(), loaded.fields.size());
+
+    std::vector<float> loadedXyz;
+    ASSERT_TRUE(cloud_compression::extractPoints(loaded, loadedXyz));
+    EXPECT_TRUE(xyz == loadedXyz);
+
+    // A file cut short is refused rather than read past its end.
+    boost::filesystem::resize_file(filename, boost::filesystem::file_size(filename) - 12);
+    EXPECT_FALSE(cloud_io::readPcd(filename, loaded));
+
+    boost::filesystem::remove(filename);
+}
+
+TEST(AnchorPoint, ignoresStalePreparedCloud)
+{
+    std::vector<float> xyz(30, 1.0);
+    std_msgs::Header header;
+    sensor_msgs::PointCloud2 cloud = cloud_compression::cloudOfPoints(xyz, header);
+    sensor_msgs::PointCloud2 prepared = cloud_compression::cloudOfPoints(std::vector<float>(3, 2.0), header);
+
+    boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(directory);
+    std::string filename = (directory / "00000.vtk").string();
+    std::string preparedFile = CloudPreparation::preparedFileOf(filename);
+    ASSERT_TRUE(cloud_io::writePcd(filename, cloud, false));
+    ASSERT_TRUE(CloudPreparation::save(preparedFile, prepared));
+
+    std::string name = "00000.vtk";
+    AnchorPoint anchorPoint(name, geometry_msgs::Pose());
+    anchorPoint.loadFromDisk(directory.string());
+    EXPECT_TRUE(anchorPoint.isPrepared());
+    EXPECT_EQ(1u, anchorPoint.getCloud().width * anchorPoint.getCloud().height);
+
+    // As left by an earlier teach.
+    boost::filesystem::last_write_time(preparedFile, boost::filesystem::last_write_time(filename) - 10);
+    anchorPoint.loadFromDisk(directory.string());
+    EXPECT_FALSE(anchorPoint.isPrepared());
+    EXPECT_EQ(10u, anchorPoint.getCloud().width * anchorPoint.getCloud().height);
+
+    boost::filesystem::remove_all(directory);
+}
+
+TEST(ScanLog, writeAndSeek)
+{
+    boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(directory);
+
+    {
+        ScanLogWriter writer(directory.string(), Eigen::Matrix4f::Identity(), 0.001, 100);
+        ASSERT_TRUE(writer.isOpen());
+
+        for(int i = 0; i < 10; i++)
+        {
+            std::vector<float> xyz(300, 0.1 * i);
+            std_msgs::Header header;
+            header.stamp = ros::Time(100.0 + i);
+            sensor_msgs::PointCloud2Ptr scan(
+                new sensor_msgs::PointCloud2(cloud_compression::cloudOfPoints(xyz, header)));
+
+            geometry_msgs::Pose pose;
+            pose.position.x = i;
+            pose.orientation.w = 1.0;
+            EXPECT_TRUE(writer.log(scan, pose));
+        }
+    }
+
+    ScanLogReader reader;
+    ASSERT_TRUE(reader.open(directory.string()));
+    ASSERT_EQ(10u, reader.size());
+
+    size_t i = reader.indexOfTime(ros::Time(103.5));
+    EXPECT_EQ(4u, i);
+
+    sensor_msgs::PointCloud2 scan;
+    geometry_msgs::Pose pose;
+    ASSERT_TRUE(reader.readScan(i, scan, pose));
+    EXPECT_DOUBLE_EQ(4.0, pose.position.x);
+    EXPECT_EQ(100u, scan.width * scan.height);
+
+    boost::filesystem::remove_all(directory);
+}
+
+TEST(TrajectoryWriter, readableByRepeat)
+{
+    boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(directory);
+    std::string positionsFile = (directory / RouteLibrary::POSITIONS_FILE).string();
+    std::string commandsFile = (directory / RouteLibrary::COMMANDS_FILE).string();
+
+    geometry_msgs::Pose pose;
+    pose.position.x = 1.5;
+    pose.position.y = -2.25;
+    pose.orientation.z = sin(0.25);
+    pose.orientation.w = cos(0.25);
+
+    {
+        TrajectoryWriter writer(positionsFile, commandsFile, 16);
+        ASSERT_TRUE(writer.isOpen());
+        EXPECT_TRUE(writer.recordPosition(12.5, pose));
+        EXPECT_TRUE(writer.recordCommand(12.75, 0.5, -0.1));
+    }
+
+    std::string line;
+    std::ifstream positions(positionsFile.c_str());
+    ASSERT_TRUE(std::getline(positions, line));
+    geometry_msgs::PoseStamped stampedPose = geo_util::stampedPoseOfString(line);
+    EXPECT_DOUBLE_EQ(12.5, stampedPose.header.stamp.toSec());
+    EXPECT_NEAR(pose.position.y, stampedPose.pose.position.y, 1e-5);
+    EXPECT_NEAR(pose.orientation.z, stampedPose.pose.orientation.z, 1e-5);
+
+    std::ifstream commands(commandsFile.c_str());
+    ASSERT_TRUE(std::getline(commands, line));
+    geometry_msgs::TwistStamped stampedTwist = geo_util::stampedTwistOfString(line);
+    EXPECT_DOUBLE_EQ(12.75, stampedTwist.header.stamp.toSec());
+    EXPECT_DOUBLE_EQ(0.5, stampedTwist.twist.linear.x);
+    EXPECT_DOUBLE_EQ(-0.1, stampedTwist.twist.angular.z);
+
+    boost::filesystem::remove_all(directory);
+}
+
+sensor_msgs::PointCloud2ConstPtr wallCloud()
+{
+    std::vector<float> xyz;
+    for(int i = -100; i <= 100; i++)
+    {
+        for(int j = 0; j < 20; j++)
+        {
+            xyz.push_back(0.1 * i);
+            xyz.push_back(5.0);
+            xyz.push_back(0.1 * j);
+        }
+    }
+
+    return sensor_msgs::PointCloud2ConstPtr(
+        new sensor_msgs::PointCloud2(cloud_compression::cloudOfPoints(xyz, std_msgs::Header())));
+}
+
+double overlapAt(OverlapEstimator& estimator, double x)
+{
+    geometry_msgs::Pose pose;
+    pose.position.x = x;
+    pose.orientation.w = 1.0;
+    estimator.submit(wallCloud(), pose);
+
+    // Out of range if the estimate never comes.
+    OverlapEstimator::Result result;
+    result.overlap = -1.0;
+    bool taken = false;
+    for(int i = 0; i < 1000 && !(taken = estimator.takeResult(result)); i++)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+    EXPECT_TRUE(taken);
+    return result.overlap;
+}
+
+TEST(OverlapEstimator, decreasesWithTravel)
+{
+    OverlapEstimator estimator(Eigen::Matrix4f::Identity(), 0.5, 30.0);
+
+    geometry_msgs::Pose origin;
+    origin.orientation.w = 1.0;
+    estimator.setReference(wallCloud(), origin);
+    ASSERT_TRUE(estimator.hasReference());
+
+    EXPECT_DOUBLE_EQ(1.0, overlapAt(estimator, 0.0));
+
+    double closeOverlap = overlapAt(estimator, 3.0);
+    double farOverlap = overlapAt(estimator, 12.0);
+    EXPECT_LT(closeOverlap, 1.0);
+    EXPECT_LT(farOverlap, closeOverlap);
+    EXPECT_DOUBLE_EQ(0.0, overlapAt(estimator, 50.0));
+}
+
+TEST(LatencyHistogram, percentiles)
+{
+    LatencyHistogram histogram;
+    for(uint64_t i = 1; i <= 1000; i++) histogram.record(i * 100);
+
+    EXPECT_EQ(1000u, histogram.count());
+    EXPECT_EQ(100000u, histogram.max());
+    EXPECT_DOUBLE_EQ(50050.0, histogram.mean());
+    EXPECT_NEAR(50000.0, histogram.percentile(50.0), 50000.0 * 0.07);
+    EXPECT_NEAR(99000.0, histogram.percentile(99.0), 99000.0 * 0.07);
+    EXPECT_EQ(histogram.max(), histogram.percentile(100.0));
+
+    for(uint64_t v = 0; v < 1000000; v += 7)
+    {
+        size_t bucket = LatencyHistogram::bucketOf(v);
+        EXPECT_LE(v, LatencyHistogram::highestValueOf(bucket));
+        if(bucket > 0)
+        {
+            EXPECT_GT(v, LatencyHistogram::highestValueOf(bucket - 1));
+        }
+    }
+}
+
+TEST(RouteLibrary, indexEntryRoundTrip)
+{
+    RouteEntry entry;
+    entry.name = "parking_lot";
+    entry.anchorCount = 42;
+    entry.minX = -1.5;
+    entry.minY = 2.0;
+    entry.maxX = 10.25;
+    entry.maxY = 20.0;
+
+    std::stringstream ss;
+    ss << entry;
+
+    RouteEntry parsed;
+    ASSERT_TRUE(ss >> parsed);
+    EXPECT_EQ(entry.name, parsed.name);
+    EXPECT_EQ(entry.anchorCount, parsed.anchorCount);
+    EXPECT_DOUBLE_EQ(entry.minX, parsed.minX);
+    EXPECT_DOUBLE_EQ(entry.maxY, parsed.maxY);
+
+    // Far from the origin, the extents keep all their digits.
+    RouteEntry far(entry);
+    far.maxX = 123456.789;
+    std::stringstream farStream;
+    farStream << far;
+    RouteEntry parsedFar;
+    ASSERT_TRUE(farStream >> parsedFar);
+    EXPECT_DOUBLE_EQ(far.maxX, parsedFar.maxX);
+
+    EXPECT_DOUBLE_EQ(0.0, parsed.distanceTo(0.0, 5.0));
+    EXPECT_DOUBLE_EQ(5.0, parsed.distanceTo(-1.5, -3.0));
+}
+
+TEST(RouteGraph, planAcrossJunction)
+{
+    // A straight route along x, and a second route branching off the first
+    // one halfway through.
+    std::vector<geometry_msgs::Pose> first, second;
+    for(int i = 0; i < 10; i++)
+    {
+        geometry_msgs::Pose pose;
+        pose.orientation.w = 1.0;
+        pose.position.x = i;
+        first.push_back(pose);
+
+        pose.position.x = 5.0;
+        pose.position.y = 0.1 + i;
+        second.push_back(pose);
+    }
+
+    RouteGraph graph;
+    graph.addRoute("first", first);
+    graph.addRoute("second", second);
+    EXPECT_GT(graph.detectJunctions(0.5), 0);
+
+    std::vector<RouteLeg> legs;
+    ASSERT_TRUE(graph.plan("first", 0, "second", -1, legs));
+    ASSERT_EQ(2u, legs.size());
+    EXPECT_EQ("first", legs[0].route);
+    EXPECT_EQ(0, legs[0].firstAnchor);
+    EXPECT_EQ("second", legs[1].route);
+    EXPECT_EQ(9, legs[1].lastAnchor);
+    EXPECT_EQ(5, legs[0].lastAnchor);
+    EXPECT_EQ(0, legs[1].firstAnchor);
+
+    EXPECT_FALSE(graph.plan("second", 0, "first", 0, legs));
+}
+
+TEST(Controller, filtersLongitudinalError)
+{
+    Controller controller;
+
+    husky_trainer::TrajectoryError error;
+    error.x = 1.0;
+    error.y = 0.2;
+    error.theta = -0.1;
+    husky_trainer::TrajectoryError corrected = controller.updateError(error);
+
+    EXPECT_GT(corrected.x, 0.0);
+    EXPECT_LT(corrected.x, error.x);
+    EXPECT_DOUBLE_EQ(error.y, corrected.y);
+    EXPECT_DOUBLE_EQ(error.theta, corrected.theta);
+
+    // The correction is capped to the speed limits of Repeat.cfg.
+    geometry_msgs::Twist command;
+    command.linear.x = -5.0;
+    command.angular.z = 5.0;
+    geometry_msgs::Twist output = controller.correctCommand(command);
+    EXPECT_DOUBLE_EQ(-1.0, output.linear.x);
+    EXPECT_DOUBLE_EQ(1.0, output.angular.z);
+}
+
+TEST(SyntheticRoute, writesATeach)
+{
+    boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+
+    SyntheticRoute route(42, 0.5, 0.5);
+    route.setPointCount(100);
+    ASSERT_TRUE(route.write(directory.string(), 20, 2));
+
+    std::vector<geometry_msgs::Pose> anchorPoses;
+    std::string line;
+    std::ifstream anchorPoints((directory / RouteLibrary::ANCHOR_POINTS_FILE).c_str());
+    while(std::getline(anchorPoints, line))
+    {
+        AnchorPoint anchorPoint(line);
+        EXPECT_EQ(SyntheticRoute::anchorPointName(anchorPoses.size()), anchorPoint.name());
+        anchorPoses.push_back(anchorPoint.getPosition());
+
+        sensor_msgs::PointCloud2 cloud;
+        ASSERT_TRUE(cloud_io::readPcd((directory / anchorPoint.name()).string(), cloud));
+        EXPECT_EQ(100u, cloud.width * cloud.height);
+    }
+    ASSERT_EQ(20u, anchorPoses.size());
+
+    for(size_t i = 1; i < anchorPoses.size(); i++)
+    {
+        EXPECT_NEAR(0.5, geo_util::euclidian_distance_of_poses(anchorPoses[i - 1], anchorPoses[i]), 0.01);
+    }
+
+    // The trajectory ends on the last anchor point.
+    std::ifstream positions((directory / RouteLibrary::POSITIONS_FILE).c_str());
+    std::string lastLine;
+    while(std::getline(positions, line)) lastLine = line;
+    geometry_msgs::PoseStamped last = geo_util::stampedPoseOfString(lastLine);
+    EXPECT_NEAR(anchorPoses.back().position.x, last.pose.position.x, 1e-3);
+    EXPECT_NEAR(anchorPoses.back().position.y, last.pose.position.y, 1e-3);
+
+    boost::filesystem::remove_all(directory);
+}
+
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv){
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,383 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include <geometry_msgs/Transform.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "husky_trainer/CloudIO.h"
+#include "husky_trainer/GeoUtil.h"
+#include "husky_trainer/LatencyHistogram.h"
+#include "husky_trainer/PointMatching.h"
+
+#define DEFAULT_STEPS 3
+#define DEFAULT_MAX_TRANSLATION 0.5
+#define DEFAULT_MAX_YAW 0.2
+#define DEFAULT_MAX_Z 0.1
+#define DEFAULT_MAX_TILT 0.05
+#define DEFAULT_NOISE "0,0.02"
+#define DEFAULT_SEED 42
+#define ITERATION_VARIABLE "Iteration"
+#define DEFAULT_ICP_NAME "default"
+
+typedef PointMatcher<float> PM;
+typedef PM::DataPoints DP;
+
+struct Options {
+    std::string cloudFile;
+    std::vector<std::string> icpConfigs;
+    unsigned int steps;
+    double maxTranslation;
+    double maxYaw;
+    double maxZ;
+    double maxTilt;
+    std::vector<double> noiseLevels;
+    unsigned int seed;
+    bool csv;
+};
+
+struct Perturbation {
+    double x, y, z, roll, pitch, yaw;
+};
+
+// The results of one ICP configuration on one grid at one noise level.
+struct Summary {
+    LatencyHistogram latency;
+    unsigned int runs;
+    unsigned int failures;
+    long iterations;
+    long maxIterations;
+    double planarError;
+    double maxPlanarError;
+    double yawError;
+    double maxYawError;
+
+    Summary() :
+        runs(0), failures(0), iterations(0), maxIterations(0), planarError(0.0), maxPlanarError(0.0),
+        yawError(0.0), maxYawError(0.0)
+    { }
+};
+
+void printUsage()
+{
+    std::cerr << "Usage: husky_trainer_matching_bench CLOUD.pcd [options]" << std::endl <<
+        "Options:" << std::endl <<
+        "  --icp-config F        ICP configuration to compare, may be given more than once." << std::endl <<
+        "                        Default: the default ICP of libpointmatcher." << std::endl <<
+        "  --steps N             Values per axis of the perturbation grids. Default: 3." << std::endl <<
+        "  --max-translation D   Largest x and y perturbation. Default: 0.5." << std::endl <<
+        "  --max-yaw A           Largest yaw perturbation. Default: 0.2." << std::endl <<
+        "  --max-z D             z perturbation of the SE(3) grid. Default: 0.1." << std::endl <<
+        "  --max-tilt A          Roll and pitch perturbation of the SE(3) grid. Default: 0.05." << std::endl <<
+        "  --noise S,S,...       Standard deviations of the noise added to the reading." << std::endl <<
+        "                        Default: 0,0.02." << std::endl <<
+        "  --seed N              Seed of the noise. Default: 42." << std::endl <<
+        "  --csv                 Print the results as CSV." << std::endl;
+}
+
+std::vector<double> doublesOfString(const std::string& in)
+{
+    std::vector<double> values;
+    std::stringstream ss(in);
+    std::string buffer;
+    while(std::getline(ss, buffer, ','))
+    {
+        values.push_back(strtod(buffer.c_str(), NULL));
+    }
+    return values;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    if(argc < 2) return false;
+
+    options.cloudFile = argv[1];
+    options.steps = DEFAULT_STEPS;
+    options.maxTranslation = DEFAULT_MAX_TRANSLATION;
+    options.maxYaw = DEFAULT_MAX_YAW;
+    options.maxZ = DEFAULT_MAX_Z;
+    options.maxTilt = DEFAULT_MAX_TILT;
+    options.noiseLevels = doublesOfString(DEFAULT_NOISE);
+    options.seed = DEFAULT_SEED;
+    options.csv = false;
+
+    for(int i = 2; i < argc; i++)
+    {
+        std::string option(argv[i]);
+        if(option == "--csv")
+        {
+            options.csv = true;
+            continue;
+        }
+
+        if(i + 1 >= argc) return false;
+        std::string value(argv[++i]);
+
+        if(option == "--icp-config") options.icpConfigs.push_back(value);
+        else if(option == "--steps") options.steps = strtoul(value.c_str(), NULL, 10);
+        else if(option == "--max-translation") options.maxTranslation = strtod(value.c_str(), NULL);
+        else if(option == "--max-yaw") options.maxYaw = strtod(value.c_str(), NULL);
+        else if(option == "--max-z") options.maxZ = strtod(value.c_str(), NULL);
+        else if(option == "--max-tilt") options.maxTilt = strtod(value.c_str(), NULL);
+        else if(option == "--noise") options.noiseLevels = doublesOfString(value);
+        else if(option == "--seed") options.seed = strtoul(value.c_str(), NULL, 10);
+        else return false;
+    }
+
+    if(options.icpConfigs.empty()) options.icpConfigs.push_back("");
+
+    return options.steps > 0 && !options.noiseLevels.empty();
+}
+
+double gridValue(double max, unsigned int step, unsigned int steps)
+{
+    return steps == 1 ? max : -max + 2.0 * max * step / (steps - 1);
+}
+
+// The SE(2) grid covers x, y and yaw. The SE(3) grid is the same grid, with
+// z, roll and pitch alternating between plus and minus their maximum.
+std::vector<Perturbation> makeGrid(const Options& options, bool se3)
+{
+    std::vector<Perturbation> grid;
+    for(unsigned int i = 0; i < options.steps; i++)
+    {
+        for(unsigned int j = 0; j < options.steps; j++)
+        {
+            for(unsigned int k = 0; k < options.steps; k++)
+            {
+                double sign = grid.size() % 2 == 0 ? 1.0 : -1.0;
+
+                Perturbation p;
+                p.x = gridValue(options.maxTranslation, i, options.steps);
+                p.y = gridValue(options.maxTranslation, j, options.steps);
+                p.yaw = gridValue(options.maxYaw, k, options.steps);
+                p.z = se3 ? sign * options.maxZ : 0.0;
+                p.roll = se3 ? sign * options.maxTilt : 0.0;
+                p.pitch = se3 ? -sign * options.maxTilt : 0.0;
+                grid.push_back(p);
+            }
+        }
+    }
+    return grid;
+}
+
+PM::TransformationParameters transformOfPerturbation(const Perturbation& p)
+{
+    Eigen::Affine3f T =
+        Eigen::Translation3f(p.x, p.y, p.z) *
+        Eigen::AngleAxisf(p.yaw, Eigen::Vector3f::UnitZ()) *
+        Eigen::AngleAxisf(p.pitch, Eigen::Vector3f::UnitY()) *
+        Eigen::AngleAxisf(p.roll, Eigen::Vector3f::UnitX());
+    return T.matrix();
+}
+
+// What the match_clouds service hands back to the repeat.
+geometry_msgs::Transform transformMsgOf(const PM::TransformationParameters& T)
+{
+    Eigen::Affine3d eigenTransform(T.cast<double>());
+    tf::Transform transform;
+    tf::transformEigenToTF(eigenTransform, transform);
+
+    geometry_msgs::Transform msg;
+    tf::transformTFToMsg(transform, msg);
+    return msg;
+}
+
+// The counter checker of the ICP keeps the number of iterations of the last
+// run, -1 if the configuration has none.
+long iterationsOf(const PM::ICP& icp)
+{
+    for(size_t i = 0; i < icp.transformationCheckers.size(); i++)
+    {
+        const PM::TransformationChecker& checker = *icp.transformationCheckers[i];
+        const std::vector<std::string>& names = checker.getConditionVariableNames();
+        for(size_t j = 0; j < names.size(); j++)
+        {
+            if(names[j] == ITERATION_VARIABLE) return static_cast<long>(checker.getConditionVariables()(j));
+        }
+    }
+    return -1;
+}
+
+bool loadIcp(const std::string& filename, PM::ICP& icp)
+{
+    if(filename.empty())
+    {
+        icp.setDefault();
+        return true;
+    }
+
+    std::ifstream config(filename.c_str());
+    if(!config.good()) return false;
+    icp.loadFromYaml(config);
+    return true;
+}
+
+void addNoise(sensor_msgs::PointCloud2& cloud, double sigma, boost::mt19937& generator)
+{
+    if(sigma <= 0.0) return;
+
+    boost::variate_generator<boost::mt19937&, boost::normal_distribution<> >
+        noise(generator, boost::normal_distribution<>(0.0, sigma));
+
+    DP points = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(cloud);
+    for(int i = 0; i < points.features.cols(); i++)
+    {
+        for(int j = 0; j < 3; j++) points.features(j, i) += noise();
+    }
+    cloud = PointMatcher_ros::pointMatcherCloudToRosMsg<float>(points, cloud.header.frame_id, cloud.header.stamp);
+}
+
+// The same steps as the repeat and the match_clouds service: the clouds come
+// in as messages, the reading is matched on the anchor point without an
+// initial guess and the transform becomes a trajectory error. The reading is
+// the reference moved by the perturbation, so the expected error is the one
+// of the inverse of the perturbation.
+void runOne(PM::ICP& icp, const sensor_msgs::PointCloud2& referenceMsg, const sensor_msgs::PointCloud2& readingMsg,
+            const PM::TransformationParameters& perturbation, Summary& summary)
+{
+    summary.runs++;
+    uint64_t start = LatencyHistogram::monotonicMicroseconds();
+
+    DP reference = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(referenceMsg);
+    DP reading = PointMatcher_ros::rosMsgToPointMatcherCloud<float>(readingMsg);
+
+    PM::TransformationParameters readingToReference;
+    try {
+        readingToReference = icp(reading, reference);
+    } catch(PM::ConvergenceError& e) {
+        summary.latency.record(LatencyHistogram::monotonicMicroseconds() - start);
+        summary.failures++;
+        return;
+    }
+
+    husky_trainer::TrajectoryError error =
+        pointmatching_tools::controlErrorOfTransformation(transformMsgOf(readingToReference));
+    summary.latency.record(LatencyHistogram::monotonicMicroseconds() - start);
+
+    husky_trainer::TrajectoryError expected =
+        pointmatching_tools::controlErrorOfTransformation(transformMsgOf(perturbation.inverse()));
+
+    double planarError = sqrt((error.x - expected.x) * (error.x - expected.x) +
+                              (error.y - expected.y) * (error.y - expected.y));
+    double yawError = fabs(atan2(sin(error.theta - expected.theta), cos(error.theta - expected.theta)));
+
+    summary.planarError += planarError;
+    summary.maxPlanarError = std::max(summary.maxPlanarError, planarError);
+    summary.yawError += yawError;
+    summary.maxYawError = std::max(summary.maxYawError, yawError);
+
+    long iterations = iterationsOf(icp);
+    summary.iterations += iterations;
+    summary.maxIterations = std::max(summary.maxIterations, iterations);
+}
+
+void printHeader(bool csv)
+{
+    if(csv)
+    {
+        printf("icp,grid,noise,runs,failures,p50_ms,p90_ms,p99_ms,max_ms,mean_iterations,max_iterations,"
+               "mean_planar_error,max_planar_error,mean_yaw_error,max_yaw_error\n");
+    }
+    else
+    {
+        printf("%-24s %-5s %6s %5s %5s %8s %8s %8s %8s %7s %7s %9s %9s %9s %9s\n",
+               "ICP", "Grid", "Noise", "Runs", "Fail", "p50 ms", "p90 ms", "p99 ms", "Max ms",
+               "Iter", "MaxIter", "Err m", "MaxErr m", "Yaw rad", "MaxYaw");
+    }
+}
+
+void printSummary(const std::string& icpName, const std::string& gridName, double noise,
+                  const Summary& summary, bool csv)
+{
+    unsigned int converged = summary.runs - summary.failures;
+    double divisor = converged > 0 ? converged : 1;
+
+    const char* format = csv ?
+        "%s,%s,%.3f,%u,%u,%.2f,%.2f,%.2f,%.2f,%.1f,%ld,%.4f,%.4f,%.4f,%.4f\n" :
+        "%-24s %-5s %6.3f %5u %5u %8.2f %8.2f %8.2f %8.2f %7.1f %7ld %9.4f %9.4f %9.4f %9.4f\n";
+
+    printf(format, icpName.c_str(), gridName.c_str(), noise, summary.runs, summary.failures,
+           summary.latency.percentile(50.0) / 1000.0, summary.latency.percentile(90.0) / 1000.0,
+           summary.latency.percentile(99.0) / 1000.0, summary.latency.max() / 1000.0,
+           summary.iterations / divisor, summary.maxIterations,
+           summary.planarError / divisor, summary.maxPlanarError,
+           summary.yawError / divisor, summary.maxYawError);
+    fflush(stdout);
+}
+
+// Matches a cloud against perturbed copies of itself, for every ICP
+// configuration, perturbation grid and noise level. The perturbations and
+// the noise are the same from one run to the next.
+int main(int argc, char** argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    ros::Time::init();
+
+    sensor_msgs::PointCloud2 reference;
+    if(!cloud_io::readPcd(options.cloudFile, reference))
+    {
+        std::cerr << "Could not read " << options.cloudFile << ", a binary PCD file is needed." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::vector<Perturbation> > > grids;
+    grids.push_back(std::make_pair(std::string("SE2"), makeGrid(options, false)));
+    grids.push_back(std::make_pair(std::string("SE3"), makeGrid(options, true)));
+
+    printHeader(options.csv);
+
+    for(size_t c = 0; c < options.icpConfigs.size(); c++)
+    {
+        const std::string& config = options.icpConfigs[c];
+        std::string icpName = config.empty() ? DEFAULT_ICP_NAME : config;
+
+        PM::ICP icp;
+        if(!loadIcp(config, icp))
+        {
+            std::cerr << "Could not open " << config << "." << std::endl;
+            return 1;
+        }
+
+        for(size_t g = 0; g < grids.size(); g++)
+        {
+            for(size_t n = 0; n < options.noiseLevels.size(); n++)
+            {
+                // Every configuration gets the same readings.
+                boost::mt19937 generator(options.seed + n);
+
+                Summary summary;
+                for(size_t p = 0; p < grids[g].second.size(); p++)
+                {
+                    PM::TransformationParameters perturbation = transformOfPerturbation(grids[g].second[p]);
+                    sensor_msgs::PointCloud2 reading = pointmatching_tools::applyTransform(reference, perturbation);
+                    reading.header.frame_id = reference.header.frame_id;
+                    addNoise(reading, options.noiseLevels[n], generator);
+
+                    runOne(icp, reference, reading, perturbation, summary);
+                }
+
+                printSummary(icpName, grids[g].first, options.noiseLevels[n], summary, options.csv);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <ros/ros.h>
+#include <sensor_msgs/Joy.h>
+
+#include "husky_trainer/ControllerMappings.h"
+#include "husky_trainer/Repeat.h"
+#include "husky_trainer/RepeatClock.h"
+#include "husky_trainer/RepeatIO.h"
+#include "husky_trainer/RouteLibrary.h"
+#include "husky_trainer/SyntheticRoute.h"
+
+#include "Benchmark.h"
+
+#define DEFAULT_ANCHOR_COUNTS "100,1000,10000,100000"
+#define DEFAULT_POINTS 500
+#define SEED 42
+
+struct Options {
+    std::vector<size_t> anchorCounts;
+    size_t pointCount;
+    std::string directory;
+    bool keep;
+    bool csv;
+};
+
+struct Result {
+    double generateSeconds;
+    double startupSeconds;
+    long residentKilobytes;
+    long peakKilobytes;
+    unsigned long ticks;
+    double tickNanoseconds;
+    std::vector<uint64_t> switchNanoseconds;
+};
+
+// Only moves when told to.
+class BenchClock : public RepeatClock {
+public:
+    BenchClock() : time(1.0) { }
+    virtual ros::Time now() const { return time; }
+    void advance(const ros::Duration& duration) { time += duration; }
+
+private:
+    ros::Time time;
+};
+
+// Drops every output but the anchor point switches, which it counts. No
+// cloud is read, so the matching never happens.
+class CountingIO : public RepeatIO {
+public:
+    CountingIO() : switches(0) { }
+
+    virtual void publishCommand(const geometry_msgs::Twist& command) { }
+    virtual void publishReferencePose(const geometry_msgs::Pose& pose) { }
+    virtual void publishRawError(const husky_trainer::TrajectoryError& error) { }
+    virtual void publishCorrectedError(const husky_trainer::TrajectoryError& error) { }
+    virtual void publishAnchorPointSwitch(const husky_trainer::AnchorPointSwitch& msg) { switches++; }
+    virtual void publishStats(const husky_trainer::RepeatStats& stats) { }
+    virtual void publishLatencyProbe(const husky_trainer::LatencyProbe& probe) { }
+    virtual bool matchClouds(pointmatcher_ros::MatchClouds& match, bool preparedReference) { return false; }
+
+    unsigned long switchCount() const { return switches; }
+
+private:
+    unsigned long switches;
+};
+
+void printUsage()
+{
+    std::cerr << "Usage: husky_trainer_route_bench [options]" << std::endl <<
+        "Options:" << std::endl <<
+        "  --anchors N,N,...     Route lengths in anchor points. Default: 100,1000,10000,100000." << std::endl <<
+        "  --points N            Points per anchor point cloud. Default: 500." << std::endl <<
+        "  --directory D         Where the routes are written. Default: a temporary directory." << std::endl <<
+        "  --keep                Keep the routes, and reuse the ones already in the directory." << std::endl <<
+        "  --csv                 Print the results as CSV." << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    std::string anchorCounts = DEFAULT_ANCHOR_COUNTS;
+    options.pointCount = DEFAULT_POINTS;
+    options.directory = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    options.keep = false;
+    options.csv = false;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string option(argv[i]);
+        if(option == "--keep")
+        {
+            options.keep = true;
+            continue;
+        }
+        if(option == "--csv")
+        {
+            options.csv = true;
+            continue;
+        }
+
+        if(i + 1 >= argc) return false;
+        std::string value(argv[++i]);
+
+        if(option == "--anchors") anchorCounts = value;
+        else if(option == "--points") options.pointCount = strtoul(value.c_str(), NULL, 10);
+        else if(option == "--directory") options.directory = value;
+        else return false;
+    }
+
+    std::stringstream ss(anchorCounts);
+    std::string buffer;
+    while(std::getline(ss, buffer, ','))
+    {
+        size_t count = strtoul(buffer.c_str(), NULL, 10);
+        if(count < 2) return false;
+        options.anchorCounts.push_back(count);
+    }
+
+    return !options.anchorCounts.empty();
+}
+
+// A field of /proc/self/status, in kB.
+long statusKilobytes(const std::string& field)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line))
+    {
+        if(line.compare(0, field.size() + 1, field + ":") == 0)
+        {
+            return strtol(line.c_str() + field.size() + 1, NULL, 10);
+        }
+    }
+    return -1;
+}
+
+double percentile(std::vector<uint64_t>& values, double fraction)
+{
+    if(values.empty()) return 0.0;
+    size_t rank = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+// Writes the route in a process of its own, so that the memory it takes
+// does not show up in the peak of the repeat.
+bool generate(const std::string& directory, size_t anchorCount, const Options& options, double& seconds)
+{
+    uint64_t start = Benchmark::nowNanoseconds();
+    pid_t child = fork();
+    if(child == 0)
+    {
+        SyntheticRoute route(SEED, DEFAULT_SYNTHETIC_AP_DISTANCE, DEFAULT_SYNTHETIC_SPEED);
+        route.setPointCount(options.pointCount);
+        _exit(route.write(directory, anchorCount, boost::thread::hardware_concurrency()) ? 0 : 1);
+    }
+
+    int status = 1;
+    bool written = child >= 0 && waitpid(child, &status, 0) >= 0 && WIFEXITED(status) &&
+        WEXITSTATUS(status) == 0;
+    seconds = (Benchmark::nowNanoseconds() - start) * 1e-9;
+    return written;
+}
+
+// Loads the route like the repeat node does at startup, then plays it
+// forward until the last anchor point, timing every tick. Only the ticks
+// that switch anchor points are kept one by one.
+bool measure(size_t anchorCount, const Options& options, Result& result)
+{
+    std::ostringstream name;
+    name << "route_" << anchorCount;
+    std::string directory = RouteLibrary::joinPath(options.directory, name.str());
+
+    result.generateSeconds = 0.0;
+    if(!options.keep ||
+       !boost::filesystem::exists(RouteLibrary::joinPath(directory, RouteLibrary::ANCHOR_POINTS_FILE)))
+    {
+        if(!generate(directory, anchorCount, options, result.generateSeconds)) return false;
+    }
+
+    BenchClock clock;
+    CountingIO io;
+
+    uint64_t start = Benchmark::nowNanoseconds();
+    Repeat repeat(directory, tf::Transform::getIdentity(), husky_trainer::RepeatConfig::__getDefault__(), clock, io);
+    result.startupSeconds = (Benchmark::nowNanoseconds() - start) * 1e-9;
+    result.residentKilobytes = statusKilobytes("VmRSS");
+    result.peakKilobytes = statusKilobytes("VmHWM");
+
+    sensor_msgs::Joy::Ptr forward(new sensor_msgs::Joy());
+    forward->buttons.resize(controller_mappings::START + 1, 0);
+    forward->buttons[controller_mappings::RB] = 1;
+    repeat.joystickCallback(forward);
+
+    // The synthetic robot reaches an anchor point every second.
+    const ros::Duration tickPeriod(1.0 / Repeat::LOOP_RATE);
+    const unsigned long maxTicks = static_cast<unsigned long>(
+        (anchorCount * DEFAULT_SYNTHETIC_AP_DISTANCE / DEFAULT_SYNTHETIC_SPEED + 10.0) * Repeat::LOOP_RATE);
+    uint64_t idleNanoseconds = 0;
+
+    result.ticks = 0;
+    result.switchNanoseconds.reserve(anchorCount);
+    while(io.switchCount() < anchorCount - 1 && result.ticks < maxTicks)
+    {
+        clock.advance(tickPeriod);
+        unsigned long switches = io.switchCount();
+
+        uint64_t tickStart = Benchmark::nowNanoseconds();
+        repeat.tick();
+        uint64_t tickTime = Benchmark::nowNanoseconds() - tickStart;
+
+        if(io.switchCount() != switches) result.switchNanoseconds.push_back(tickTime);
+        else idleNanoseconds += tickTime;
+        result.ticks++;
+    }
+
+    unsigned long idleTicks = result.ticks - result.switchNanoseconds.size();
+    result.tickNanoseconds = idleTicks > 0 ? static_cast<double>(idleNanoseconds) / idleTicks : 0.0;
+
+    if(!options.keep) boost::filesystem::remove_all(directory);
+    return true;
+}
+
+void printHeader(bool csv)
+{
+    if(csv)
+    {
+        printf("anchors,generate_s,startup_s,rss_mb,peak_mb,ticks,tick_ns,switches,switch_p50_ns,"
+               "switch_p99_ns,switch_max_ns\n");
+    }
+    else
+    {
+        printf("%8s %10s %10s %9s %9s %10s %8s %8s %10s %10s %10s\n", "Anchors", "Generate s", "Startup s",
+               "RSS MB", "Peak MB", "Ticks", "Tick ns", "Switches", "Sw p50 ns", "Sw p99 ns", "Sw max ns");
+    }
+}
+
+void printResult(size_t anchorCount, Result& result, bool csv)
+{
+    const char* format = csv ?
+        "%lu,%.3f,%.3f,%.1f,%.1f,%lu,%.1f,%lu,%.0f,%.0f,%.0f\n" :
+        "%8lu %10.3f %10.3f %9.1f %9.1f %10lu %8.1f %8lu %10.0f %10.0f %10.0f\n";
+
+    printf(format, static_cast<unsigned long>(anchorCount), result.generateSeconds, result.startupSeconds,
+           result.residentKilobytes / 1024.0, result.peakKilobytes / 1024.0, result.ticks,
+           result.tickNanoseconds, static_cast<unsigned long>(result.switchNanoseconds.size()),
+           percentile(result.switchNanoseconds, 0.5), percentile(result.switchNanoseconds, 0.99),
+           percentile(result.switchNanoseconds, 1.0));
+}
+
+// Every route length is measured in its own process, so that the memory
+// taken by one does not show up in the next.
+int main(int argc, char** argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    ros::Time::init();
+    if(ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn))
+    {
+        ros::console::notifyLoggerLevelsChanged();
+    }
+
+    printHeader(options.csv);
+    fflush(stdout);
+
+    int failures = 0;
+    for(size_t i = 0; i < options.anchorCounts.size(); i++)
+    {
+        pid_t child = fork();
+        if(child == 0)
+        {
+            Result result;
+            bool measured = measure(options.anchorCounts[i], options, result);
+            if(measured) printResult(options.anchorCounts[i], result, options.csv);
+            fflush(stdout);
+            _exit(measured ? 0 : 1);
+        }
+
+        int status = 1;
+        if(child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "Could not measure the route of " << options.anchorCounts[i] << " anchor points." <<
+                std::endl;
+            failures++;
+        }
+    }
+
+    if(!options.keep) boost::filesystem::remove_all(options.directory);
+    return failures == 0 ? 0 : 1;
+}